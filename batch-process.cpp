@@ -0,0 +1,488 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/utility.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "evaluation.hpp"
+#include "recorder.hpp"
+#include "tracking-core.hpp"
+
+// Time between progress reports, seconds
+const std::chrono::seconds PROGRESS_PERIOD{2};
+
+/**
+ * @brief A recorded flight and the target to track in it.
+ */
+struct Recording {
+    std::string name;
+    std::string video;
+    cv::Rect roi;
+    // Frame the target is selected on
+    int start_frame = 0;
+};
+
+/**
+ * @brief What the pipeline did over one recording.
+ */
+struct BatchResult {
+    bool processed = false;
+    int frames = 0;
+    int tracked = 0;
+    // Frames on which commands were held back, and frames spent lost
+    int gated = 0;
+    int lost = 0;
+    int commands = 0;
+    int roc_trips = 0;
+    // Processing time, seconds
+    double seconds = 0;
+};
+
+/**
+ * @brief How far through its recording a worker is, read by the progress
+ * reports on the main thread.
+ */
+struct Progress {
+    std::atomic<int> frame{0};
+    std::atomic<int> total{0};
+    std::atomic<bool> active{false};
+};
+
+/**
+ * @brief Parse a target, `x,y,w,h [FRAME]`. Commas, tabs and spaces are all
+ * accepted as separators.
+ *
+ * @param   fields  The fields, after any recording name
+ * @param   roi     Set to the target
+ * @param   frame   Set to the frame, 0 if not given
+ * @return          `false` if there is no target
+ */
+bool parseRoi(std::istream &fields, cv::Rect &roi, int &frame) {
+    if (!(fields >> roi.x >> roi.y >> roi.width >> roi.height)) {
+        return false;
+    }
+    if (!(fields >> frame)) {
+        frame = 0;
+    }
+    return roi.width > 0 && roi.height > 0;
+}
+
+/**
+ * @brief Replace the separators of a line with spaces.
+ */
+std::string spaced(std::string line) {
+    for (char &c : line) {
+        if (c == ',' || c == '\t') {
+            c = ' ';
+        }
+    }
+    return line;
+}
+
+/**
+ * @brief Load a targets file, one `NAME x,y,w,h [FRAME]` line per recording,
+ * where NAME is the file name without extension.
+ *
+ * @param   path    The targets file
+ * @return          The targets, by recording name
+ */
+std::map<std::string, Recording> loadTargets(const std::string &path) {
+    std::map<std::string, Recording> targets;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(spaced(line));
+        Recording target;
+        if (fields >> target.name &&
+            parseRoi(fields, target.roi, target.start_frame)) {
+            targets[target.name] = target;
+        }
+    }
+    return targets;
+}
+
+/**
+ * @brief Find the target for a recording without one in the targets file:
+ * a `NAME.roi` file beside it holding `x,y,w,h [FRAME]`, or else the first
+ * annotated box of a `NAME.txt` ground truth file, as used by
+ * `tracking-eval`.
+ *
+ * @param   recording   The recording, `roi` and `start_frame` are set
+ * @return              `false` if there is no target
+ */
+bool findTarget(Recording &recording) {
+    std::filesystem::path path = recording.video;
+    path.replace_extension(".roi");
+    std::ifstream roi_file(path);
+    std::string line;
+    if (std::getline(roi_file, line)) {
+        std::istringstream fields(spaced(line));
+        return parseRoi(fields, recording.roi, recording.start_frame);
+    }
+
+    path.replace_extension(".txt");
+    if (!std::filesystem::exists(path)) {
+        return false;
+    }
+    const std::vector<cv::Rect2d> truth = loadGroundTruth(path.string());
+    for (size_t i = 0; i < truth.size(); i++) {
+        if (truth[i].width > 0 && truth[i].height > 0) {
+            recording.roi = cv::Rect(truth[i]);
+            recording.start_frame = static_cast<int>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Find the recordings to process, with their targets. Directories are
+ * searched for videos, skipping overlay videos (`*_dirty`), and recordings
+ * without a target are skipped.
+ *
+ * @param   inputs  Recordings and directories of recordings
+ * @param   targets Targets from the targets file, by recording name
+ * @return          The recordings, sorted by name
+ */
+std::vector<Recording>
+findRecordings(const std::vector<std::string> &inputs,
+               const std::map<std::string, Recording> &targets) {
+    std::vector<std::filesystem::path> videos;
+    for (const std::string &input : inputs) {
+        if (!std::filesystem::is_directory(input)) {
+            videos.emplace_back(input);
+            continue;
+        }
+        std::error_code error;
+        std::filesystem::directory_iterator entries(input, error);
+        if (error) {
+            std::cout << "Skipping " << input << ", " << error.message()
+                      << std::endl;
+            continue;
+        }
+        for (const auto &entry : entries) {
+            const std::filesystem::path path = entry.path();
+            const std::string extension = path.extension().string();
+            const std::string stem = path.stem().string();
+            const bool dirty = stem.size() >= 6 &&
+                               stem.compare(stem.size() - 6, 6, "_dirty") == 0;
+            if ((extension == ".avi" || extension == ".mp4" ||
+                 extension == ".mkv") &&
+                !dirty) {
+                videos.push_back(path);
+            }
+        }
+    }
+
+    std::vector<Recording> recordings;
+    for (const std::filesystem::path &path : videos) {
+        Recording recording;
+        recording.name = path.stem().string();
+        recording.video = path.string();
+        const auto target = targets.find(recording.name);
+        if (target != targets.end()) {
+            recording.roi = target->second.roi;
+            recording.start_frame = target->second.start_frame;
+        } else if (!findTarget(recording)) {
+            std::cout << "Skipping " << path.filename().string()
+                      << ", no target" << std::endl;
+            continue;
+        }
+        recordings.push_back(recording);
+    }
+    std::sort(recordings.begin(), recordings.end(),
+              [](const Recording &a, const Recording &b) {
+                  return a.name < b.name;
+              });
+    return recordings;
+}
+
+/**
+ * @brief Run the tracking and command pipeline over a recording, as it would
+ * have run in flight, and write an annotated video and per-frame telemetry.
+ *
+ * There is no drone to acknowledge commands, so a discrete command is logged
+ * on every frame which needs one rather than once the drone is ready, and
+ * `rocCheck` trips are counted rather than stopping the run.
+ *
+ * @param   recording       The recording
+ * @param   tracker_name    The tracker backend
+ * @param   rc              Use the continuous `rc` controller
+ * @param   output          The output directory
+ * @param   progress        Updated as frames are processed
+ * @return                  What the pipeline did
+ */
+BatchResult processRecording(const Recording &recording,
+                             const std::string &tracker_name, bool rc,
+                             const std::string &output, Progress &progress) {
+    BatchResult result;
+    cv::VideoCapture cap(recording.video);
+    if (!cap.isOpened()) {
+        std::cout << "Cannot open " << recording.video << std::endl;
+        return result;
+    }
+    const double fps = cap.get(cv::CAP_PROP_FPS) > 0
+                           ? cap.get(cv::CAP_PROP_FPS)
+                           : 30;
+    progress.total = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_COUNT));
+    const auto start = std::chrono::steady_clock::now();
+
+    cv::Mat frame;
+    for (int i = 0; i < recording.start_frame; i++) {
+        cap.grab();
+    }
+    if (!cap.read(frame)) {
+        std::cout << recording.name << " has no frame "
+                  << recording.start_frame << std::endl;
+        return result;
+    }
+    // Select the target as the user would have
+    cv::Rect roi = recording.roi & cv::Rect(0, 0, frame.cols, frame.rows);
+    const cv::Size roi_size = roi.size();
+    if (!checkROI(roi_size, frame.cols, frame.rows, ROI_MIN, ROI_MAX)) {
+        std::cout << recording.name << " target is outside the allowed size"
+                  << std::endl;
+        return result;
+    }
+    cv::Ptr<cv::Tracker> tracker = createTracker(tracker_name);
+    tracker->init(frame, roi);
+
+    SegmentedWriter video;
+    video.open(output + recording.name + "_annotated", Codec::MJPG, fps,
+               frame.size());
+    std::ofstream telemetry(output + recording.name + ".csv");
+    telemetry << "frame,time,tracked,confidence,state,x,y,width,height,"
+                 "command\n";
+
+    std::deque<int> history;
+    // Commands are generated exactly as the live control stage would
+    FollowControl control(rc);
+    CommandText text;
+    cv::Mat image;
+    for (int index = recording.start_frame + 1; cap.read(frame); index++) {
+        const double time = index / fps;
+        const bool tracked = tracker->update(frame, roi);
+        const float confidence = trackerConfidence(tracker);
+        // The recorded drone was flying and there is none to wait for
+        const ControlOutput out = control.step(time, roi, roi_size, tracked,
+                                               confidence, true, false);
+        const TrackState state = control.state();
+        result.frames++;
+        result.tracked += tracked;
+        result.gated += state != TrackState::Tracking;
+        result.lost += state == TrackState::Lost;
+        // A failed update leaves a stale ROI, there is no new size to check
+        if (tracked && !rocCheck(roi, history)) {
+            // The live system would stop here, count it and carry on
+            result.roc_trips++;
+            history.clear();
+        }
+        const DroneCommand &command = out.command;
+        result.commands += out.send;
+
+        frame.copyTo(image);
+        drawTracking(image, roi, state, rc, out.velocity, out.planar, command);
+        video.write(image);
+        telemetry << index << "," << time << "," << tracked << ","
+                  << confidence << "," << trackStateName(state) << ","
+                  << roi.x << "," << roi.y << "," << roi.width << ","
+                  << roi.height << "," << text.format(command) << "\n";
+        progress.frame = index + 1;
+    }
+    video.release();
+    result.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    result.processed = true;
+    return result;
+}
+
+/**
+ * @brief Write the summary, one line per recording and the totals, as
+ * `key value` pairs like the `tracking-eval` report.
+ *
+ * @param   out         The stream to write to
+ * @param   recordings  The recordings
+ * @param   results     Their results, in the same order
+ */
+void writeSummary(std::ostream &out, const std::vector<Recording> &recordings,
+                  const std::vector<BatchResult> &results) {
+    BatchResult total;
+    size_t processed = 0;
+    for (size_t i = 0; i < recordings.size(); i++) {
+        const BatchResult &result = results[i];
+        out << "recording " << recordings[i].name;
+        if (!result.processed) {
+            out << " failed" << std::endl;
+            continue;
+        }
+        const double frames = std::max(1, result.frames);
+        out << " frames " << result.frames << " tracked "
+            << result.tracked / frames << " gated " << result.gated / frames
+            << " lost " << result.lost / frames << " commands "
+            << result.commands << " roc_trips " << result.roc_trips << " fps "
+            << result.frames / std::max(result.seconds, 1e-9) << std::endl;
+        processed++;
+        total.frames += result.frames;
+        total.tracked += result.tracked;
+        total.gated += result.gated;
+        total.lost += result.lost;
+        total.commands += result.commands;
+        total.roc_trips += result.roc_trips;
+        total.seconds += result.seconds;
+    }
+    const double frames = std::max(1, total.frames);
+    out << "overall recordings " << processed << "/" << recordings.size()
+        << " frames " << total.frames << " tracked " << total.tracked / frames
+        << " gated " << total.gated / frames << " lost "
+        << total.lost / frames << " commands " << total.commands
+        << " roc_trips " << total.roc_trips << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> inputs;
+    std::string targets_path;
+    std::string tracker_name = "csrt";
+    bool rc = false;
+    std::string output = "../video-output/batch/";
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Check command line arguments and set variables based on these
+    bool valid = true;
+    for (int i = 1; i < argc && valid; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--targets" && i + 1 < argc) {
+            targets_path = argv[++i];
+        } else if (arg == "--tracker" && i + 1 < argc) {
+            tracker_name = argv[++i];
+        } else if (arg == "--controller" && i + 1 < argc) {
+            const std::string name = argv[++i];
+            valid = name == "steer" || name == "rc";
+            rc = name == "rc";
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+            if (output.back() != '/') {
+                output += '/';
+            }
+        } else if (arg.rfind("--", 0) != 0) {
+            inputs.push_back(arg);
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid || inputs.empty() || !createTracker(tracker_name)) {
+        std::cout << "Incorrect usage, please use: ";
+        std::cout << "./batch-process RECORDING|DIR... [--targets FILE] "
+                     "[--tracker csrt|kcf|cf] [--controller steer|rc] "
+                     "[--threads N] [--output DIR]"
+                  << std::endl;
+        return 0;
+    }
+
+    std::map<std::string, Recording> targets;
+    if (!targets_path.empty()) {
+        targets = loadTargets(targets_path);
+    }
+    const std::vector<Recording> recordings =
+        findRecordings(inputs, targets);
+    if (recordings.empty()) {
+        std::cout << "No recordings with targets found" << std::endl;
+        return 0;
+    }
+    std::filesystem::create_directories(output);
+    threads = std::min<unsigned int>(threads, recordings.size());
+    // Recordings run in parallel, stop OpenCV also splitting each frame
+    // across the same cores
+    if (threads > 1) {
+        cv::setNumThreads(1);
+    }
+
+    // Workers take the next recording from a shared counter until none are
+    // left
+    std::vector<BatchResult> results(recordings.size());
+    std::vector<Progress> progress(recordings.size());
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex print_mutex;
+    auto worker = [&]() {
+        for (size_t i = next++; i < recordings.size(); i = next++) {
+            progress[i].active = true;
+            results[i] = processRecording(recordings[i], tracker_name, rc,
+                                          output, progress[i]);
+            progress[i].active = false;
+            const BatchResult &result = results[i];
+            std::lock_guard<std::mutex> lock(print_mutex);
+            std::cout << "[" << ++done << "/" << recordings.size() << "] "
+                      << recordings[i].name << " "
+                      << (result.processed ? "done" : "failed") << ", "
+                      << result.frames << " frames at "
+                      << result.frames / std::max(result.seconds, 1e-9)
+                      << " fps" << std::endl;
+        }
+    };
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned int i = 0; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+
+    // Report the recordings in progress until every one is done
+    auto last_report = start;
+    while (done < recordings.size()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() - last_report < PROGRESS_PERIOD) {
+            continue;
+        }
+        last_report = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(print_mutex);
+        for (size_t i = 0; i < recordings.size(); i++) {
+            if (!progress[i].active) {
+                continue;
+            }
+            const int frame = progress[i].frame;
+            const int total = progress[i].total;
+            std::cout << "  " << recordings[i].name << " " << frame;
+            if (total > 0) {
+                std::cout << "/" << total << " (" << std::fixed
+                          << std::setprecision(0)
+                          << 100.0 * std::min(frame, total) / total << "%)"
+                          << std::defaultfloat << std::setprecision(6);
+            }
+            std::cout << std::endl;
+        }
+    }
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+    const double wall = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+    const std::string summary_path = output + "summary.txt";
+    std::ofstream summary(summary_path);
+    writeSummary(summary, recordings, results);
+    summary.close();
+    writeSummary(std::cout, recordings, results);
+    int frames = 0;
+    for (const BatchResult &result : results) {
+        frames += result.frames;
+    }
+    std::cout << "Processed " << frames << " frames in " << wall << "s on "
+              << threads << " threads, " << frames / std::max(wall, 1e-9)
+              << " fps. Annotated videos, telemetry and " << summary_path
+              << " written to " << output << std::endl;
+}
@@ -0,0 +1,339 @@
+#ifndef CF_TRACKER_HPP
+#define CF_TRACKER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/tracking.hpp>
+
+/**
+ * @brief Normalise a float32 patch in place for correlation: log transform,
+ * zero mean, unit norm and multiplied by the cosine window. The mean/norm and
+ * windowing passes are written with OpenCV universal intrinsics so they are
+ * vectorised on both x86 and ARM.
+ *
+ * @param   features    The patch, continuous `CV_32F`
+ * @param   window      The cosine window, same size as `features`
+ */
+inline void normaliseFeatures(cv::Mat &features, const cv::Mat &window) {
+    CV_Assert(features.isContinuous() && window.isContinuous());
+    // log(x + 1) reduces the effect of lighting changes
+    cv::add(features, cv::Scalar::all(1), features);
+    cv::log(features, features);
+
+    float *data = features.ptr<float>();
+    const float *weights = window.ptr<float>();
+    const int n = static_cast<int>(features.total());
+    int i = 0;
+    float sum = 0;
+    float sum_sq = 0;
+#if CV_SIMD
+    const int lanes = cv::v_float32::nlanes;
+    cv::v_float32 v_sum = cv::vx_setzero_f32();
+    cv::v_float32 v_sum_sq = cv::vx_setzero_f32();
+    for (; i <= n - lanes; i += lanes) {
+        const cv::v_float32 v = cv::vx_load(data + i);
+        v_sum = v_sum + v;
+        v_sum_sq = cv::v_fma(v, v, v_sum_sq);
+    }
+    sum = cv::v_reduce_sum(v_sum);
+    sum_sq = cv::v_reduce_sum(v_sum_sq);
+#endif
+    for (; i < n; i++) {
+        sum += data[i];
+        sum_sq += data[i] * data[i];
+    }
+
+    const float mean = sum / n;
+    const float norm = std::sqrt(std::max(sum_sq - n * mean * mean, 1e-5f));
+    const float inv_norm = 1 / norm;
+    i = 0;
+#if CV_SIMD
+    const cv::v_float32 v_mean = cv::vx_setall_f32(mean);
+    const cv::v_float32 v_inv_norm = cv::vx_setall_f32(inv_norm);
+    for (; i <= n - lanes; i += lanes) {
+        const cv::v_float32 v = cv::vx_load(data + i);
+        cv::v_store(data + i,
+                    (v - v_mean) * v_inv_norm * cv::vx_load(weights + i));
+    }
+    cv::vx_cleanup();
+#endif
+    for (; i < n; i++) {
+        data[i] = (data[i] - mean) * inv_norm * weights[i];
+    }
+}
+
+/**
+ * @brief A MOSSE correlation filter tracker with PSR confidence and a three
+ * level scale search, implementing the same `init`/`update` interface as the
+ * OpenCV trackers.
+ *
+ * The search window around the target is resampled to a fixed template whose
+ * longest side is `TEMPLATE_SIZE`, so the cost of an update does not depend on
+ * the size of the ROI. All buffers are continuous float32 matrices allocated
+ * in `init` and reused by every `update`.
+ */
+class TrackerCF : public cv::Tracker {
+  public:
+    // Longest side of the filter template, in pixels
+    static constexpr int TEMPLATE_SIZE = 64;
+    // Size of the search window relative to the ROI
+    static constexpr float PADDING = 2.0f;
+    // Weight of the newest frame when updating the filter
+    static constexpr float LEARNING_RATE = 0.125f;
+    // Width of the desired gaussian response, in template pixels
+    static constexpr float SIGMA = 2.0f;
+    // Peak to sidelobe ratio below which the target is considered lost
+    static constexpr float PSR_THRESHOLD = 7.0f;
+    // Ratio between the scales searched each frame. A 5% step resolves the
+    // 20% band used by `LongitudinalMove` within a few frames
+    static constexpr float SCALE_STEP = 1.05f;
+    // Penalty on scale changes, so noise alone does not change the size
+    static constexpr float SCALE_PENALTY = 0.97f;
+    // Number of randomly warped samples used to train the initial filter
+    static constexpr int PERTURBATIONS = 8;
+
+    static cv::Ptr<TrackerCF> create() { return cv::makePtr<TrackerCF>(); }
+
+    void init(cv::InputArray image, const cv::Rect &boundingBox) override {
+        const cv::Mat frame = image.getMat();
+        centre = cv::Point2f(boundingBox.x + boundingBox.width / 2.0f,
+                             boundingBox.y + boundingBox.height / 2.0f);
+        target_size = cv::Size2f(boundingBox.width, boundingBox.height);
+        scale = 1;
+
+        // Fix the template size, the search window is sampled to match it
+        // so that one template pixel is `resample` image pixels
+        const float longest =
+            PADDING * std::max(target_size.width, target_size.height);
+        resample = longest / TEMPLATE_SIZE;
+        template_size = cv::Size(
+            cv::getOptimalDFTSize(
+                cvRound(PADDING * target_size.width / resample)),
+            cv::getOptimalDFTSize(
+                cvRound(PADDING * target_size.height / resample)));
+
+        cv::createHanningWindow(window, template_size, CV_32F);
+        cv::Mat gaussian(template_size, CV_32F);
+        const float cx = template_size.width / 2.0f;
+        const float cy = template_size.height / 2.0f;
+        for (int y = 0; y < template_size.height; y++) {
+            float *row = gaussian.ptr<float>(y);
+            for (int x = 0; x < template_size.width; x++) {
+                const float d2 = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+                row[x] = std::exp(-d2 / (2 * SIGMA * SIGMA));
+            }
+        }
+        cv::dft(gaussian, target_spectrum, cv::DFT_COMPLEX_OUTPUT);
+        sidelobe_mask.create(template_size, CV_8U);
+
+        // Train on the target and small random warps of it, a single sample
+        // gives a filter which overfits the first frame
+        crop(frame, centre, scale, gray);
+        numerator = cv::Mat::zeros(template_size, CV_32FC2);
+        denominator = cv::Mat::zeros(template_size, CV_32FC2);
+        cv::RNG rng(0);
+        cv::Mat warped;
+        for (int i = 0; i < PERTURBATIONS; i++) {
+            if (i == 0) {
+                gray.copyTo(warped);
+            } else {
+                const cv::Mat warp = cv::getRotationMatrix2D(
+                    cv::Point2f(cx, cy), rng.uniform(-10.0, 10.0),
+                    rng.uniform(0.95, 1.05));
+                cv::warpAffine(gray, warped, warp, template_size,
+                               cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+            }
+            warped.convertTo(features, CV_32F);
+            normaliseFeatures(features, window);
+            accumulate(features, 1);
+        }
+        updateFilter();
+        psr = std::numeric_limits<float>::max();
+    }
+
+    bool update(cv::InputArray image, cv::Rect &boundingBox) override {
+        const cv::Mat frame = image.getMat();
+        float best_peak = -std::numeric_limits<float>::max();
+        float best_scale = scale;
+        cv::Point best_location;
+        for (const float factor : {1.0f, SCALE_STEP, 1 / SCALE_STEP}) {
+            crop(frame, centre, scale * factor, gray);
+            gray.convertTo(features, CV_32F);
+            normaliseFeatures(features, window);
+            cv::Point location;
+            float candidate_psr;
+            float peak = correlate(features, location, candidate_psr);
+            if (factor != 1.0f) {
+                peak *= SCALE_PENALTY;
+            }
+            if (peak > best_peak) {
+                best_peak = peak;
+                best_scale = scale * factor;
+                best_location = location;
+                psr = candidate_psr;
+            }
+        }
+
+        // On a weak peak keep the last position and leave the filter alone,
+        // learning from the wrong patch is how correlation trackers drift
+        if (psr < PSR_THRESHOLD) {
+            boundingBox = box();
+            return false;
+        }
+
+        const float step = resample * best_scale;
+        centre.x += (best_location.x - template_size.width / 2.0f) * step;
+        centre.y += (best_location.y - template_size.height / 2.0f) * step;
+        scale = std::clamp(best_scale, 0.2f, 5.0f);
+
+        crop(frame, centre, scale, gray);
+        gray.convertTo(features, CV_32F);
+        normaliseFeatures(features, window);
+        accumulate(features, LEARNING_RATE);
+        updateFilter();
+
+        boundingBox = box();
+        return true;
+    }
+
+    /**
+     * @brief The peak to sidelobe ratio of the last update, higher is more
+     * confident. Values below `PSR_THRESHOLD` are reported as failures.
+     */
+    float getConfidence() const { return psr; }
+
+    /**
+     * @brief Move the search window before the next `update`, e.g. by the
+     * shift of the whole image when the drone moves, so the search only has
+     * to cover the target's own motion.
+     */
+    void translate(cv::Point2f shift) { centre += shift; }
+
+  private:
+    /**
+     * @brief Resample the search window at a position and scale into the
+     * greyscale template buffer. The window is warped straight to the
+     * template size, so no buffer depends on the scale searched.
+     */
+    void crop(const cv::Mat &frame, cv::Point2f at, float at_scale,
+              cv::Mat &out) {
+        // Template pixel to image pixel, centred on `at` as `getRectSubPix`
+        // and `resize` would place it
+        const double step = resample * at_scale;
+        const cv::Matx23d warp(
+            step, 0, at.x + (0.5 - template_size.width / 2.0) * step, 0, step,
+            at.y + (0.5 - template_size.height / 2.0) * step);
+        cv::warpAffine(frame, resized, warp, template_size,
+                       cv::INTER_LINEAR | cv::WARP_INVERSE_MAP,
+                       cv::BORDER_REPLICATE);
+        if (resized.channels() == 3) {
+            cv::cvtColor(resized, out, cv::COLOR_BGR2GRAY);
+        } else {
+            resized.copyTo(out);
+        }
+    }
+
+    /**
+     * @brief Correlate the filter with a template and find the response peak.
+     *
+     * @param   sample      The normalised template
+     * @param   location    Set to the position of the peak in the template
+     * @param   ratio       Set to the peak to sidelobe ratio
+     * @return              The peak value
+     */
+    float correlate(const cv::Mat &sample, cv::Point &location, float &ratio) {
+        cv::dft(sample, spectrum, cv::DFT_COMPLEX_OUTPUT);
+        cv::mulSpectrums(spectrum, filter, product, 0, false);
+        cv::idft(product, response, cv::DFT_SCALE | cv::DFT_REAL_OUTPUT);
+        double peak;
+        cv::minMaxLoc(response, nullptr, &peak, nullptr, &location);
+
+        // Sidelobe is everything outside an 11x11 window around the peak
+        sidelobe_mask.setTo(cv::Scalar::all(255));
+        cv::rectangle(sidelobe_mask,
+                      cv::Rect(location.x - 5, location.y - 5, 11, 11),
+                      cv::Scalar::all(0), cv::FILLED);
+        cv::Scalar mean, stddev;
+        cv::meanStdDev(response, mean, stddev, sidelobe_mask);
+        ratio = static_cast<float>((peak - mean[0]) / (stddev[0] + 1e-5));
+        return static_cast<float>(peak);
+    }
+
+    /**
+     * @brief Blend a new sample into the filter numerator and denominator,
+     * `rate` of 1 adds it with full weight.
+     */
+    void accumulate(const cv::Mat &sample, float rate) {
+        cv::dft(sample, spectrum, cv::DFT_COMPLEX_OUTPUT);
+        // G * conj(F)
+        cv::mulSpectrums(target_spectrum, spectrum, product, 0, true);
+        // F * conj(F), the imaginary part is zero
+        cv::mulSpectrums(spectrum, spectrum, energy, 0, true);
+        if (rate >= 1) {
+            numerator += product;
+            denominator += energy;
+        } else {
+            cv::addWeighted(product, rate, numerator, 1 - rate, 0, numerator);
+            cv::addWeighted(energy, rate, denominator, 1 - rate, 0,
+                            denominator);
+        }
+    }
+
+    /**
+     * @brief H* = A / B. B is real so this is a scale of each complex value.
+     */
+    void updateFilter() {
+        filter.create(template_size, CV_32FC2);
+        const int n = static_cast<int>(numerator.total());
+        const float *a = numerator.ptr<float>();
+        const float *b = denominator.ptr<float>();
+        float *h = filter.ptr<float>();
+        for (int i = 0; i < n; i++) {
+            const float inv = 1 / (b[2 * i] + 1e-5f);
+            h[2 * i] = a[2 * i] * inv;
+            h[2 * i + 1] = a[2 * i + 1] * inv;
+        }
+    }
+
+    cv::Rect box() const {
+        const cv::Size2f size(target_size.width * scale,
+                              target_size.height * scale);
+        return cv::Rect(cvRound(centre.x - size.width / 2),
+                        cvRound(centre.y - size.height / 2),
+                        cvRound(size.width), cvRound(size.height));
+    }
+
+    // Target state
+    cv::Point2f centre;
+    cv::Size2f target_size;
+    float scale = 1;
+    float psr = 0;
+
+    // Template geometry, image pixels per template pixel at scale 1
+    float resample = 1;
+    cv::Size template_size;
+
+    // Filter state, all `template_size`
+    cv::Mat window;
+    cv::Mat target_spectrum;
+    cv::Mat numerator;
+    cv::Mat denominator;
+    cv::Mat filter;
+
+    // Scratch buffers, reused every update
+    cv::Mat resized;
+    cv::Mat gray;
+    cv::Mat features;
+    cv::Mat spectrum;
+    cv::Mat product;
+    cv::Mat energy;
+    cv::Mat response;
+    cv::Mat sidelobe_mask;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef COMMAND_LINK_HPP
+#define COMMAND_LINK_HPP
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "ctello.h"
+
+/**
+ * @brief The command channel to one drone: SDK commands out, responses back.
+ * `receiveResponse` never blocks.
+ */
+class CommandLink {
+  public:
+    virtual ~CommandLink() = default;
+
+    /**
+     * @brief Bind the local command port and put the drone into SDK mode.
+     *
+     * @param   local_port  The local UDP port to send from
+     * @return              `false` if the drone did not answer
+     */
+    virtual bool bind(int local_port) = 0;
+    virtual bool sendCommand(std::string_view command) = 0;
+    virtual std::optional<std::string> receiveResponse() = 0;
+
+    /**
+     * @brief Whether there is no real drone behind the link, so commands are
+     * always sent rather than only when flying.
+     */
+    virtual bool simulated() const { return false; }
+};
+
+/**
+ * @brief The drone on the Tello's own WiFi network, through ctello, which
+ * always talks to 192.168.10.1:8889.
+ */
+class CTelloLink : public CommandLink {
+  public:
+    CTelloLink() { text.reserve(64); }
+
+    bool bind(int local_port) override { return tello.Bind(local_port); }
+
+    bool sendCommand(std::string_view command) override {
+        // ctello takes a string, reuse one so sending does not allocate
+        text.assign(command.data(), command.size());
+        return tello.SendCommand(text);
+    }
+
+    std::optional<std::string> receiveResponse() override {
+        return tello.ReceiveResponse();
+    }
+
+  private:
+    ctello::Tello tello;
+    std::string text;
+};
+
+/**
+ * @brief A drone, or a simulated one, at any address and port. Used when a
+ * session is given `--drone HOST:PORT`, e.g. Tello EDUs in station mode or
+ * `fake-tello` endpoints on the same machine.
+ */
+class UdpTelloLink : public CommandLink {
+  public:
+    // Time to wait for the drone to answer `command` when binding
+    static constexpr std::chrono::seconds BIND_TIMEOUT{5};
+
+    /**
+     * @param   host    The drone's address or host name
+     * @param   port    The drone's command port, 8889 on a Tello
+     */
+    UdpTelloLink(const std::string &host, int port) : host(host), port(port) {}
+
+    ~UdpTelloLink() override {
+        if (socket_fd >= 0) {
+            close(socket_fd);
+        }
+    }
+
+    bool bind(int local_port) override {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo *found = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                        &found) != 0) {
+            return false;
+        }
+        drone = *reinterpret_cast<sockaddr_in *>(found->ai_addr);
+        freeaddrinfo(found);
+
+        socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (socket_fd < 0) {
+            return false;
+        }
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(local_port);
+        if (::bind(socket_fd, reinterpret_cast<sockaddr *>(&local),
+                   sizeof(local)) < 0) {
+            return false;
+        }
+
+        // Enter SDK mode, as ctello does
+        sendCommand("command");
+        const auto deadline = std::chrono::steady_clock::now() + BIND_TIMEOUT;
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (receiveResponse()) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+    bool sendCommand(std::string_view command) override {
+        return sendto(socket_fd, command.data(), command.size(), 0,
+                      reinterpret_cast<const sockaddr *>(&drone),
+                      sizeof(drone)) == static_cast<ssize_t>(command.size());
+    }
+
+    std::optional<std::string> receiveResponse() override {
+        char buffer[256];
+        const ssize_t length =
+            recv(socket_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (length <= 0) {
+            return std::nullopt;
+        }
+        return std::string(buffer, length);
+    }
+
+  private:
+    std::string host;
+    int port;
+    int socket_fd = -1;
+    sockaddr_in drone{};
+};
+
+#endif
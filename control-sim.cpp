@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "tracking-core.hpp"
+#include "virtual-plant.hpp"
+
+// Simulated frame rate, the Tello streams at 30fps
+const double FRAME_RATE = 30;
+// Error the target has to stay within to count as settled, pixels. Just over
+// the `Steer` dead band of `MIN_STEP / CM_PER_PIXEL`
+const double SETTLE_BAND = 80;
+// Time the target has to stay within the band at the end of a run, seconds
+const double SETTLE_HOLD = 1;
+
+/**
+ * @brief A disturbance applied just after the target was selected, the
+ * controller has to bring the target back to the centre of the view.
+ */
+struct Scenario {
+    std::string name;
+    PlantPose offset;
+};
+
+/**
+ * @brief How well one controller recovered from one disturbance.
+ */
+struct RunResult {
+    bool settled = false;
+    // Time until the target was last outside the band, seconds
+    double settling_time = 0;
+    // Largest error past the centre, as a percentage of the initial error
+    double overshoot = 0;
+    int commands = 0;
+    // Error at the end of the run, pixels, and size relative to the selection
+    double final_error = 0;
+    double final_size = 1;
+};
+
+/**
+ * @brief Run one controller against one disturbance.
+ *
+ * @param   config      The plant settings
+ * @param   world       The world image, empty for a generated one
+ * @param   scenario    The disturbance
+ * @param   controller  `steer` or `rc`
+ * @param   tracker     Tracker backend, or `none` to use the true target box
+ * @param   duration    Simulated time to run for, seconds
+ * @param   seed        Seed for the actuation noise
+ */
+RunResult runScenario(const PlantConfig &config, const cv::Mat &world,
+                      const Scenario &scenario, const std::string &controller,
+                      const std::string &tracker_name, double duration,
+                      std::uint64_t seed) {
+    VirtualPlant plant(config, world, seed);
+    const double dt = 1 / FRAME_RATE;
+
+    // Select the target as the user would, centred at the selection distance
+    cv::Rect roi = plant.targetBox();
+    const cv::Size roi_size = roi.size();
+    cv::Ptr<cv::Tracker> tracker;
+    cv::Mat view;
+    if (tracker_name != "none") {
+        tracker = createTracker(tracker_name);
+        plant.render(view);
+        tracker->init(view, roi);
+    }
+    plant.setPose(scenario.offset);
+
+    RunResult result;
+    const cv::Rect disturbed = plant.targetBox(false);
+    const cv::Point2d initial(
+        (disturbed.br() + disturbed.tl()) / 2 - DRONE_POSITION);
+    const double initial_error = std::max(1.0, cv::norm(initial));
+    double last_outside = 0;
+    double max_past_centre = 0;
+    bool busy = false;
+    CommandText text;
+    // Commands are generated exactly as in `tracking-drone`
+    FollowControl control(controller == "rc");
+
+    while (plant.time() < duration) {
+        plant.step(dt);
+        if (plant.receive()) {
+            busy = false;
+        }
+
+        // What the controller sees, through the tracker or perfectly
+        bool tracked = true;
+        float confidence = -1;
+        if (tracker) {
+            plant.render(view);
+            tracked = tracker->update(view, roi);
+            confidence = trackerConfidence(tracker);
+        } else {
+            roi = plant.targetBox();
+        }
+
+        const ControlOutput out = control.step(
+            plant.time(), roi, roi_size, tracked, confidence, true, busy);
+        if (out.send) {
+            plant.send(text.format(out.command));
+            busy = out.command.acknowledged();
+            result.commands++;
+        }
+
+        // Score against where the target really is now
+        const cv::Rect truth = plant.targetBox(false);
+        const cv::Point2d error =
+            cv::Point2d((truth.br() + truth.tl()) / 2 - DRONE_POSITION);
+        const double size = (static_cast<double>(truth.width) /
+                                 roi_size.width +
+                             static_cast<double>(truth.height) /
+                                 roi_size.height) /
+                            2;
+        if (cv::norm(error) > SETTLE_BAND || std::abs(size - 1) > ROI_SCALE) {
+            last_outside = plant.time();
+        }
+        // Distance past the centre along the direction of the initial error
+        const double along = error.dot(initial) / initial_error;
+        max_past_centre = std::max(max_past_centre, -along);
+        result.final_error = cv::norm(error);
+        result.final_size = size;
+    }
+    result.settled = duration - last_outside >= SETTLE_HOLD;
+    result.settling_time = last_outside;
+    result.overshoot = 100 * max_past_centre / initial_error;
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    PlantConfig config;
+    std::vector<std::string> controllers = {"steer", "rc"};
+    std::string tracker_name = "none";
+    std::string world_path;
+    double duration = 20;
+    int repeats = 3;
+
+    // Check command line arguments and set variables based on these
+    bool valid = true;
+    for (int i = 1; i < argc && valid; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            valid = false;
+        } else if (arg == "--controller") {
+            const std::string name = argv[++i];
+            valid = name == "steer" || name == "rc";
+            controllers = {name};
+        } else if (arg == "--tracker") {
+            tracker_name = argv[++i];
+            valid = tracker_name == "none" || createTracker(tracker_name);
+        } else if (arg == "--world") {
+            world_path = argv[++i];
+        } else if (arg == "--duration") {
+            duration = std::atof(argv[++i]);
+        } else if (arg == "--repeats") {
+            repeats = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--latency") {
+            config.latency = std::atof(argv[++i]);
+        } else if (arg == "--video-latency") {
+            config.video_latency = std::atof(argv[++i]);
+        } else if (arg == "--noise") {
+            config.noise = std::atof(argv[++i]);
+        } else if (arg == "--drift") {
+            config.drift = std::atof(argv[++i]);
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        std::cout << "Incorrect usage, please use: ";
+        std::cout << "./control-sim [--controller steer|rc] "
+                     "[--tracker none|csrt|kcf|cf] [--world IMAGE] "
+                     "[--duration S] [--repeats N] [--latency S] "
+                     "[--video-latency S] [--noise F] [--drift CM_PER_S]"
+                  << std::endl;
+        return 0;
+    }
+    cv::Mat world;
+    if (!world_path.empty()) {
+        world = cv::imread(world_path);
+        if (world.empty()) {
+            std::cout << "Cannot open " << world_path << std::endl;
+            return 0;
+        }
+    } else if (tracker_name != "none") {
+        // Generate once rather than for every run
+        world = VirtualPlant::generateWorld(config);
+    }
+
+    // Step disturbances, x right, y up, z towards the target, cm
+    const std::vector<Scenario> scenarios = {
+        {"left", {-40, 0, 0, 0}},      {"up", {0, 30, 0, 0}},
+        {"diagonal", {50, -25, 0, 0}}, {"away", {0, 0, -60, 0}},
+        {"closer", {0, 0, 40, 0}},     {"mixed", {-30, 20, -40, 0}},
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    double simulated = 0;
+    for (const std::string &controller : controllers) {
+        RunResult total;
+        int settled = 0;
+        int runs = 0;
+        for (const Scenario &scenario : scenarios) {
+            for (int repeat = 0; repeat < repeats; repeat++) {
+                const RunResult result =
+                    runScenario(config, world, scenario, controller,
+                                tracker_name, duration, repeat + 1);
+                simulated += duration;
+                runs++;
+                settled += result.settled;
+                total.settling_time += result.settling_time;
+                total.overshoot += result.overshoot;
+                total.commands += result.commands;
+                std::cout << controller << " " << scenario.name << " #"
+                          << repeat << " settled " << result.settled
+                          << " settling_time " << result.settling_time
+                          << "s overshoot " << result.overshoot
+                          << "% commands " << result.commands
+                          << " final_error " << result.final_error
+                          << "px final_size " << result.final_size
+                          << std::endl;
+            }
+        }
+        std::cout << controller << " overall settled " << settled << "/"
+                  << runs << " settling_time " << total.settling_time / runs
+                  << "s overshoot " << total.overshoot / runs
+                  << "% commands " << static_cast<double>(total.commands) / runs
+                  << std::endl;
+    }
+    const double wall = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+    std::cout << "Simulated " << simulated << "s in " << wall << "s, "
+              << simulated / std::max(wall, 1e-9) << "x real time"
+              << std::endl;
+}
@@ -0,0 +1,156 @@
+#ifndef CROP_RECORDER_HPP
+#define CROP_RECORDER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "pipeline.hpp"
+#include "recorder.hpp"
+
+/**
+ * @brief An evaluation recording of what matters in each frame, instead of
+ * the whole frame with overlays burnt in:
+ * - `NAME_crop` - a square window around the ROI, scaled to `CROP_SIZE`, so a
+ *   small target is upscaled, encoded losslessly with FFV1.
+ * - `NAME_thumbnail` - the whole frame at a quarter size, for one frame in
+ *   `THUMBNAIL_EVERY`, with MJPG.
+ * - `NAME_crop.csv` - one line per frame with the window, the ROI and the
+ *   rest of what the overlays show, so they can be drawn afterwards at any
+ *   size, or measured against ground truth.
+ *
+ * Only the crop and the occasional thumbnail are encoded, about a fifth of
+ * the pixels of the overlay video, and the frame itself is only read.
+ */
+class CropRecorder {
+  public:
+    // Side of the recorded window
+    static constexpr int CROP_SIZE = 384;
+    // Side of the window around the ROI, as a multiple of the ROI's longer
+    // side, and the smallest window, which is upscaled twice
+    static constexpr double CONTEXT = 2.0;
+    static constexpr int MIN_WINDOW = CROP_SIZE / 2;
+    static constexpr int THUMBNAIL_EVERY = 10;
+    static constexpr double THUMBNAIL_SCALE = 0.25;
+
+    /**
+     * @brief Open the recordings.
+     *
+     * @param   base        The path without extension
+     * @param   fps         The frame rate of the stream
+     * @param   frame_size  The size of the stream's frames
+     * @param   policy      When to start a new segment
+     * @return              `false` if a file could not be opened
+     */
+    bool open(const std::string &base, double fps, cv::Size frame_size,
+              SegmentPolicy policy = SegmentPolicy()) {
+        this->frame_size = frame_size;
+        frames = 0;
+        thumbnails = 0;
+        window = cv::Rect();
+        const cv::Size thumbnail_size(
+            cvRound(frame_size.width * THUMBNAIL_SCALE),
+            cvRound(frame_size.height * THUMBNAIL_SCALE));
+        metadata.open(base + "_crop.csv", std::ios::trunc);
+        metadata << "frame,captured_ms,window_x,window_y,window_size,"
+                    "thumbnail,roi_x,roi_y,roi_width,roi_height,tracked,"
+                    "confidence,state,command,velocity_x,velocity_y,ego_x,"
+                    "ego_y\n";
+        return crop.open(base + "_crop", Codec::FFV1, fps,
+                         cv::Size(CROP_SIZE, CROP_SIZE), policy) &&
+               thumbnail.open(base + "_thumbnail", Codec::MJPG,
+                              fps / THUMBNAIL_EVERY, thumbnail_size,
+                              policy) &&
+               metadata.good();
+    }
+
+    /**
+     * @brief Record a frame which has been through the control stage.
+     */
+    void write(const FramePacket &packet) {
+        if (frames == 0) {
+            first = packet.captured;
+        }
+        follow(packet.roi);
+        const cv::Mat source(packet.frame, window);
+        cv::resize(source, scaled, cv::Size(CROP_SIZE, CROP_SIZE), 0, 0,
+                   window.width < CROP_SIZE ? cv::INTER_CUBIC
+                                            : cv::INTER_AREA);
+        crop.write(scaled);
+
+        long long thumbnail_index = -1;
+        if (frames % THUMBNAIL_EVERY == 0) {
+            cv::resize(packet.frame, small, cv::Size(), THUMBNAIL_SCALE,
+                       THUMBNAIL_SCALE, cv::INTER_AREA);
+            thumbnail.write(small);
+            thumbnail_index = static_cast<long long>(thumbnails++);
+        }
+        frames++;
+
+        const cv::Rect &roi = packet.roi;
+        metadata << packet.id << ","
+                 << std::chrono::duration<double, std::milli>(packet.captured -
+                                                              first)
+                        .count()
+                 << "," << window.x << "," << window.y << "," << window.width
+                 << "," << thumbnail_index << "," << roi.x << "," << roi.y
+                 << "," << roi.width << "," << roi.height << ","
+                 << packet.tracked << "," << packet.confidence << ","
+                 << trackStateName(packet.state) << ",\""
+                 << text.format(packet.command) << "\","
+                 << packet.velocity.x << "," << packet.velocity.y << ","
+                 << packet.ego_shift.x << "," << packet.ego_shift.y << "\n";
+    }
+
+    /**
+     * @brief Flush and close the recordings.
+     */
+    void release() {
+        crop.release();
+        thumbnail.release();
+        metadata.close();
+    }
+
+    // Number of segments of the crop written so far
+    size_t segments() const { return crop.segments(); }
+
+  private:
+    // Centre the window on the ROI, at a size for it, moved rather than cut
+    // at the frame's edges. Without a ROI it stays where it was, or at the
+    // middle of the frame
+    void follow(const cv::Rect &roi) {
+        const int limit = std::min(frame_size.width, frame_size.height);
+        cv::Point centre(frame_size.width / 2, frame_size.height / 2);
+        int side = std::min(MIN_WINDOW, limit);
+        if (roi.width > 0 && roi.height > 0) {
+            centre = (roi.tl() + roi.br()) / 2;
+            side = std::max(side, cvRound(std::max(roi.width, roi.height) *
+                                          CONTEXT));
+        } else if (window.width > 0) {
+            return;
+        }
+        side = std::min(side, limit);
+        window = cv::Rect(
+            std::clamp(centre.x - side / 2, 0, frame_size.width - side),
+            std::clamp(centre.y - side / 2, 0, frame_size.height - side),
+            side, side);
+    }
+
+    SegmentedWriter crop;
+    SegmentedWriter thumbnail;
+    std::ofstream metadata;
+    CommandText text;
+    cv::Size frame_size;
+    cv::Rect window;
+    cv::Mat scaled;
+    cv::Mat small;
+    std::uint64_t frames = 0;
+    std::uint64_t thumbnails = 0;
+    Clock::time_point first;
+};
+
+#endif
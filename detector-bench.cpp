@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "detector.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// Frame period and budget at the Tello's 30fps
+const std::chrono::microseconds FRAME_PERIOD{33333};
+const double FRAME_BUDGET_MS = 1000.0 / 30;
+// The Tello's stream resolution, synthetic frames are this size and clips
+// are resized to it
+const cv::Size STREAM_SIZE(960, 720);
+// Untimed runs before each measurement, the first inferences allocate
+const int WARM_UP = 3;
+
+/**
+ * @brief Mean, 50th and 99th percentile and maximum of some times.
+ */
+std::string summary(std::vector<double> times, const std::string &unit) {
+    if (times.empty()) {
+        return "none";
+    }
+    double total = 0;
+    for (double time : times) {
+        total += time;
+    }
+    std::sort(times.begin(), times.end());
+    std::ostringstream out;
+    out << "mean " << total / times.size() << unit << " p50 "
+        << times[times.size() / 2] << unit << " p99 "
+        << times[times.size() * 99 / 100] << unit << " max " << times.back()
+        << unit;
+    return out.str();
+}
+
+/**
+ * @brief Time inference on every frame back to back, as if it ran on the
+ * per-frame path.
+ *
+ * @param   model   The ONNX model
+ * @param   size    The network input size
+ * @param   frames  The frames
+ */
+void benchSync(const std::string &model, int size,
+               const std::vector<cv::Mat> &frames) {
+    Detector detector;
+    if (!detector.load(model, size)) {
+        std::cout << "Cannot load " << model << std::endl;
+        return;
+    }
+    for (int i = 0; i < WARM_UP; i++) {
+        detector.detect(frames[i % frames.size()]);
+    }
+    std::vector<double> times;
+    times.reserve(frames.size());
+    size_t found = 0;
+    for (const cv::Mat &frame : frames) {
+        const auto start = Clock::now();
+        found += detector.detect(frame).size();
+        times.push_back(
+            std::chrono::duration<double, std::milli>(Clock::now() - start)
+                .count());
+    }
+    double total = 0;
+    for (double time : times) {
+        total += time;
+    }
+    std::cout << size << " sync    inference " << summary(times, "ms")
+              << " throughput " << 1000 * times.size() / total
+              << "fps detections/frame "
+              << static_cast<double>(found) / frames.size() << " budget used "
+              << 100 * total / times.size() / FRAME_BUDGET_MS << "%"
+              << std::endl;
+}
+
+/**
+ * @brief Feed the frames at 30fps to an `AsyncDetector` as the track stage
+ * does, timing what the per-frame loop pays to submit and collect, and how
+ * old results are when they arrive.
+ *
+ * @param   model   The ONNX model
+ * @param   size    The network input size
+ * @param   frames  The frames
+ */
+void benchAsync(const std::string &model, int size,
+                const std::vector<cv::Mat> &frames) {
+    AsyncDetector detector;
+    if (!detector.start(model, size)) {
+        std::cout << "Cannot load " << model << std::endl;
+        return;
+    }
+    AsyncDetector::Result result;
+    std::vector<double> loop_times;
+    std::vector<double> latencies;
+    std::vector<double> inference;
+    loop_times.reserve(frames.size());
+    size_t submitted = 0;
+    auto next = Clock::now();
+    for (size_t i = 0; i < frames.size() + WARM_UP; i++) {
+        std::this_thread::sleep_until(next);
+        next += FRAME_PERIOD;
+        const auto captured = Clock::now();
+        const bool timed = i >= WARM_UP;
+        const bool taken =
+            detector.submit(frames[i % frames.size()], i, captured);
+        const bool collected = detector.poll(result);
+        const auto done = Clock::now();
+        if (!timed) {
+            continue;
+        }
+        submitted += taken;
+        loop_times.push_back(
+            std::chrono::duration<double, std::micro>(done - captured)
+                .count());
+        if (collected && result.frame_id >= WARM_UP) {
+            latencies.push_back(std::chrono::duration<double, std::milli>(
+                                    done - result.captured)
+                                    .count());
+            inference.push_back(result.inference_ms);
+        }
+    }
+    detector.stop();
+    std::cout << size << " async   per-frame cost " << summary(loop_times, "us")
+              << std::endl;
+    std::cout << size << " async   capture to result "
+              << summary(latencies, "ms") << " inference "
+              << summary(inference, "ms") << " frames detected "
+              << 100.0 * submitted / frames.size() << "%" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string model;
+    std::string clip;
+    std::vector<int> sizes = {320, 416, 640};
+    size_t max_frames = 300;
+
+    // Check command line arguments and set variables based on these
+    bool valid = true;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            max_frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            sizes.clear();
+            std::stringstream list(argv[++i]);
+            std::string size;
+            while (std::getline(list, size, ',')) {
+                sizes.push_back(
+                    std::max(32, std::atoi(size.c_str()) / 32 * 32));
+            }
+        } else if (model.empty() && arg.rfind("--", 0) != 0) {
+            model = arg;
+        } else if (clip.empty() && arg.rfind("--", 0) != 0) {
+            clip = arg;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid || model.empty() || sizes.empty()) {
+        std::cout << "Incorrect usage, please use: ";
+        std::cout << "./detector-bench MODEL.onnx [CLIP] [--sizes 320,416,640] "
+                     "[--frames N]"
+                  << std::endl;
+        return 0;
+    }
+
+    // Decode up front so only the detector is timed
+    std::vector<cv::Mat> frames;
+    if (!clip.empty()) {
+        cv::VideoCapture cap(clip);
+        if (!cap.isOpened()) {
+            std::cout << "Cannot open " << clip << std::endl;
+            return 0;
+        }
+        cv::Mat frame;
+        while (frames.size() < max_frames && cap.read(frame)) {
+            cv::Mat resized;
+            cv::resize(frame, resized, STREAM_SIZE);
+            frames.push_back(resized);
+        }
+    } else {
+        // Noise has no objects but costs the same to run the network on
+        cv::RNG rng;
+        for (size_t i = 0; i < std::min<size_t>(max_frames, 30); i++) {
+            cv::Mat frame(STREAM_SIZE, CV_8UC3);
+            rng.fill(frame, cv::RNG::UNIFORM, 0, 256);
+            frames.push_back(frame);
+        }
+        while (frames.size() < max_frames) {
+            frames.push_back(frames[frames.size() % 30]);
+        }
+    }
+    if (frames.empty()) {
+        std::cout << "No frames in " << clip << std::endl;
+        return 0;
+    }
+    std::cout << "Detecting on " << frames.size() << " frames of "
+              << STREAM_SIZE.width << "x" << STREAM_SIZE.height << " with "
+              << cv::getNumThreads() << " OpenCV threads" << std::endl;
+
+    for (int size : sizes) {
+        benchSync(model, size, frames);
+        benchAsync(model, size, frames);
+    }
+}
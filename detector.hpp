@@ -0,0 +1,261 @@
+#ifndef DETECTOR_HPP
+#define DETECTOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+#include <opencv2/imgproc.hpp>
+
+/**
+ * @brief One object found by the detector, in frame pixels.
+ */
+struct Detection {
+    cv::Rect box;
+    int class_id = -1;
+    float score = 0;
+};
+
+/**
+ * @brief Intersection over union of two boxes, 0 if either is empty.
+ */
+inline float overlap(const cv::Rect &a, const cv::Rect &b) {
+    const float intersection = (a & b).area();
+    const float total = a.area() + b.area() - intersection;
+    return total > 0 ? intersection / total : 0;
+}
+
+/**
+ * @brief A YOLOv5 style ONNX detector run on the CPU by OpenCV's DNN module.
+ * Quantised models load the same way. The frame is letterboxed into a square
+ * input, so boxes keep the frame's aspect ratio, and the output rows of
+ * `cx, cy, w, h, objectness, class scores...` are filtered and merged by
+ * non-maximum suppression. Buffers are reused between calls.
+ */
+class Detector {
+  public:
+    static constexpr float SCORE_THRESHOLD = 0.4f;
+    static constexpr float NMS_THRESHOLD = 0.45f;
+
+    /**
+     * @brief Load a model.
+     *
+     * @param   model       Path to the ONNX file
+     * @param   input_size  Side of the square network input, a multiple of 32
+     * @return              Whether the model loaded
+     */
+    bool load(const std::string &model, int input_size) {
+        try {
+            net = cv::dnn::readNetFromONNX(model);
+        } catch (const cv::Exception &) {
+            return false;
+        }
+        if (net.empty()) {
+            return false;
+        }
+        net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+        net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+        size = input_size;
+        letterbox.create(size, size, CV_8UC3);
+        return true;
+    }
+
+    /**
+     * @brief Detect objects in a frame.
+     *
+     * @param   frame   The BGR frame
+     * @return          The detections, valid until the next call
+     */
+    const std::vector<Detection> &detect(const cv::Mat &frame) {
+        const float scale = std::min(static_cast<float>(size) / frame.cols,
+                                     static_cast<float>(size) / frame.rows);
+        letterbox.setTo(cv::Scalar::all(114));
+        cv::Mat inner = letterbox(cv::Rect(0, 0, cvRound(frame.cols * scale),
+                                           cvRound(frame.rows * scale)));
+        cv::resize(frame, inner, inner.size(), 0, 0, cv::INTER_LINEAR);
+        cv::dnn::blobFromImage(letterbox, blob, 1 / 255.0, cv::Size(),
+                               cv::Scalar(), true, false);
+        net.setInput(blob);
+        net.forward(outputs, net.getUnconnectedOutLayersNames());
+
+        boxes.clear();
+        scores.clear();
+        classes.clear();
+        // [1, rows, 5 + classes]
+        const cv::Mat &output = outputs[0];
+        const int rows = output.size[1];
+        const int width = output.size[2];
+        const float *data = reinterpret_cast<const float *>(output.data);
+        for (int i = 0; i < rows; i++, data += width) {
+            if (data[4] < SCORE_THRESHOLD) {
+                continue;
+            }
+            const float *best = std::max_element(data + 5, data + width);
+            const float score = data[4] * *best;
+            if (score < SCORE_THRESHOLD) {
+                continue;
+            }
+            const float w = data[2] / scale;
+            const float h = data[3] / scale;
+            boxes.emplace_back(cvRound(data[0] / scale - w / 2),
+                               cvRound(data[1] / scale - h / 2), cvRound(w),
+                               cvRound(h));
+            scores.push_back(score);
+            classes.push_back(static_cast<int>(best - (data + 5)));
+        }
+        cv::dnn::NMSBoxes(boxes, scores, SCORE_THRESHOLD, NMS_THRESHOLD, kept);
+
+        detections.clear();
+        for (int index : kept) {
+            detections.push_back({boxes[index], classes[index], scores[index]});
+        }
+        return detections;
+    }
+
+    int inputSize() const { return size; }
+
+  private:
+    cv::dnn::Net net;
+    int size = 0;
+    cv::Mat letterbox;
+    cv::Mat blob;
+    std::vector<cv::Mat> outputs;
+    std::vector<cv::Rect> boxes;
+    std::vector<float> scores;
+    std::vector<int> classes;
+    std::vector<int> kept;
+    std::vector<Detection> detections;
+};
+
+/**
+ * @brief Runs a `Detector` on a thread of its own. `submit` hands it a frame
+ * only if it is idle and `poll` collects a finished result, neither waits for
+ * inference, so a caller on the per-frame path is never held up however long
+ * the model takes; frames arriving while it is busy are simply not detected.
+ */
+class AsyncDetector {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Result {
+        // The frame the detections were made on
+        std::uint64_t frame_id = 0;
+        Clock::time_point captured;
+        // Time spent in `Detector::detect`, milliseconds
+        double inference_ms = 0;
+        std::vector<Detection> detections;
+    };
+
+    ~AsyncDetector() { stop(); }
+
+    /**
+     * @brief Load the model and start the thread.
+     *
+     * @return  Whether the model loaded
+     */
+    bool start(const std::string &model, int input_size) {
+        if (!detector.load(model, input_size)) {
+            return false;
+        }
+        running = true;
+        thread = std::thread(&AsyncDetector::run, this);
+        return true;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    /**
+     * @brief Start detecting on a copy of a frame, if the previous frame is
+     * finished.
+     *
+     * @return  Whether the frame was taken
+     */
+    bool submit(const cv::Mat &frame, std::uint64_t frame_id,
+                Clock::time_point captured) {
+        if (busy.load(std::memory_order_acquire)) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            frame.copyTo(input);
+            pending.frame_id = frame_id;
+            pending.captured = captured;
+            busy.store(true, std::memory_order_release);
+        }
+        wake.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Take the newest finished result, if there is one.
+     *
+     * @param   result  Swapped with the finished result, so its buffers are
+     *                  reused
+     * @return          Whether there was a new result
+     */
+    bool poll(Result &result) {
+        if (!ready.load(std::memory_order_acquire)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(result, finished);
+        ready.store(false, std::memory_order_release);
+        return true;
+    }
+
+    bool isBusy() const { return busy.load(std::memory_order_acquire); }
+
+  private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this]() { return !running || busy; });
+            if (!running) {
+                return;
+            }
+            // The caller does not touch `input` or `pending` while busy
+            lock.unlock();
+            const auto start = Clock::now();
+            const std::vector<Detection> &detections = detector.detect(input);
+            pending.inference_ms =
+                std::chrono::duration<double, std::milli>(Clock::now() -
+                                                          start)
+                    .count();
+            pending.detections.assign(detections.begin(), detections.end());
+            lock.lock();
+            std::swap(pending, finished);
+            ready.store(true, std::memory_order_release);
+            busy.store(false, std::memory_order_release);
+        }
+    }
+
+    Detector detector;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running = false;
+    std::atomic<bool> busy{false};
+    std::atomic<bool> ready{false};
+    cv::Mat input;
+    Result pending;
+    Result finished;
+};
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef DRONE_COMMAND_HPP
+#define DRONE_COMMAND_HPP
+
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string_view>
+
+/**
+ * @brief Velocity setpoints for the Tello `rc a b c d` command, each in the
+ * range [-100, 100].
+ */
+struct RCSetpoint {
+    // a - left (-) / right (+)
+    int lateral = 0;
+    // b - back (-) / forward (+)
+    int forward = 0;
+    // c - down (-) / up (+)
+    int vertical = 0;
+    // d - yaw anticlockwise (-) / clockwise (+)
+    int yaw = 0;
+
+    bool isZero() const {
+        return lateral == 0 && forward == 0 && vertical == 0 && yaw == 0;
+    }
+};
+
+/**
+ * @brief The movement commands the controllers generate.
+ */
+enum class Verb : std::uint8_t {
+    None,
+    Left,
+    Right,
+    Up,
+    Down,
+    Forward,
+    Back,
+    Cw,
+    Ccw,
+    Rc
+};
+
+/**
+ * @brief The SDK name of a verb, empty for `None`.
+ */
+inline std::string_view verbName(Verb verb) {
+    switch (verb) {
+    case Verb::Left:
+        return "left";
+    case Verb::Right:
+        return "right";
+    case Verb::Up:
+        return "up";
+    case Verb::Down:
+        return "down";
+    case Verb::Forward:
+        return "forward";
+    case Verb::Back:
+        return "back";
+    case Verb::Cw:
+        return "cw";
+    case Verb::Ccw:
+        return "ccw";
+    case Verb::Rc:
+        return "rc";
+    default:
+        return "";
+    }
+}
+
+/**
+ * @brief A movement command as the controllers generate it, only turned into
+ * SDK text by `CommandText` when it is sent, so generating, comparing and
+ * drawing commands never allocates or parses text.
+ */
+struct DroneCommand {
+    Verb verb = Verb::None;
+    // Distance in cm, or angle in degrees, of a discrete move
+    int amount = 0;
+    // Velocity setpoints of an `rc` command
+    RCSetpoint velocity;
+
+    /**
+     * @brief A discrete move, e.g. `left 20`.
+     */
+    static DroneCommand move(Verb verb, int amount) {
+        DroneCommand command;
+        command.verb = verb;
+        command.amount = amount;
+        return command;
+    }
+
+    /**
+     * @brief An `rc` velocity command.
+     */
+    static DroneCommand rc(const RCSetpoint &setpoint) {
+        DroneCommand command;
+        command.verb = Verb::Rc;
+        command.velocity = setpoint;
+        return command;
+    }
+
+    bool empty() const { return verb == Verb::None; }
+
+    // The drone answers every command except `rc`
+    bool acknowledged() const { return verb != Verb::Rc; }
+};
+
+/**
+ * @brief Serialises commands into SDK text in a fixed buffer. The text is
+ * only valid until the next call.
+ */
+class CommandText {
+  public:
+    /**
+     * @param   command The command
+     * @return          The SDK text, e.g. `rc 10 0 -5 0`, empty for no command
+     */
+    std::string_view format(const DroneCommand &command) {
+        length = 0;
+        append(verbName(command.verb));
+        if (command.verb == Verb::Rc) {
+            append(command.velocity.lateral);
+            append(command.velocity.forward);
+            append(command.velocity.vertical);
+            append(command.velocity.yaw);
+        } else if (!command.empty()) {
+            append(command.amount);
+        }
+        return std::string_view(buffer.data(), length);
+    }
+
+  private:
+    void append(std::string_view text) {
+        std::memcpy(buffer.data() + length, text.data(), text.size());
+        length += text.size();
+    }
+
+    void append(int value) {
+        buffer[length++] = ' ';
+        length = std::to_chars(buffer.data() + length,
+                               buffer.data() + buffer.size(), value)
+                     .ptr -
+                 buffer.data();
+    }
+
+    // Longest is `rc` with four 11 character numbers
+    std::array<char, 64> buffer{};
+    size_t length = 0;
+};
+
+/**
+ * @brief Print a command as SDK text, for logs.
+ */
+inline std::ostream &operator<<(std::ostream &out,
+                                const DroneCommand &command) {
+    CommandText text;
+    return out << text.format(command);
+}
+
+#endif
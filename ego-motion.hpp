@@ -0,0 +1,129 @@
+#ifndef EGO_MOTION_HPP
+#define EGO_MOTION_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+/**
+ * @brief Estimates how far the whole image moved between frames because the
+ * drone moved, from sparse Lucas-Kanade flow of background corners on a
+ * downscaled greyscale copy of the frame.
+ *
+ * The shift is the median flow on each axis rather than a fitted transform, a
+ * Tello only moves along and about axes that shift the image almost uniformly
+ * at the distances it tracks from, and the median ignores the target and
+ * anything else moving as long as most corners are background. Corners are
+ * carried from frame to frame and only detected again when too few survive,
+ * and every buffer is a member reused by the next frame.
+ */
+class EgoMotion {
+  public:
+    // Scale of the frame the flow is computed on, 960x720 becomes 240x180
+    static constexpr double DOWNSCALE = 0.25;
+    // Corners detected at a time, and the number below which they are
+    // detected again
+    static constexpr int MAX_CORNERS = 64;
+    static constexpr int MIN_CORNERS = 24;
+    // Corners that must be followed for a shift to be reported
+    static constexpr int MIN_FLOWS = 8;
+    // Margin kept clear around the target when detecting corners, relative
+    // to the size of its ROI
+    static constexpr float TARGET_MARGIN = 0.25f;
+
+    /**
+     * @brief Forget the previous frame, e.g. when the stream restarts.
+     */
+    void reset() {
+        previous.release();
+        corners.clear();
+    }
+
+    /**
+     * @brief Estimate the shift since the previous frame.
+     *
+     * @param   frame   The BGR frame
+     * @param   target  The target's ROI in the previous frame, kept clear of
+     *                  corners, empty when nothing is tracked
+     * @param   shift   Set to the shift of the background in frame pixels
+     * @return          Whether enough corners were followed to estimate it
+     */
+    bool estimate(const cv::Mat &frame, const cv::Rect &target,
+                  cv::Point2f &shift) {
+        cv::resize(frame, small, cv::Size(), DOWNSCALE, DOWNSCALE,
+                   cv::INTER_AREA);
+        cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+        const cv::Rect excluded = scaledTarget(target);
+
+        bool valid = false;
+        if (!previous.empty() && previous.size() == gray.size() &&
+            !corners.empty()) {
+            cv::calcOpticalFlowPyrLK(previous, gray, corners, followed, status,
+                                     errors, cv::Size(15, 15), 2);
+            dx.clear();
+            dy.clear();
+            kept.clear();
+            for (size_t i = 0; i < status.size(); i++) {
+                if (!status[i] || excluded.contains(cv::Point(followed[i]))) {
+                    continue;
+                }
+                dx.push_back(followed[i].x - corners[i].x);
+                dy.push_back(followed[i].y - corners[i].y);
+                kept.push_back(followed[i]);
+            }
+            corners.swap(kept);
+            if (dx.size() >= MIN_FLOWS) {
+                shift = cv::Point2f(median(dx), median(dy)) / DOWNSCALE;
+                valid = true;
+            }
+        }
+
+        if (static_cast<int>(corners.size()) < MIN_CORNERS) {
+            mask.create(gray.size(), CV_8U);
+            mask.setTo(255);
+            mask(excluded & cv::Rect(cv::Point(), gray.size())).setTo(0);
+            cv::goodFeaturesToTrack(gray, corners, MAX_CORNERS, 0.01, 8, mask);
+        }
+        cv::swap(previous, gray);
+        return valid;
+    }
+
+  private:
+    cv::Rect scaledTarget(const cv::Rect &target) const {
+        if (target.width <= 0 || target.height <= 0) {
+            return cv::Rect();
+        }
+        const int margin_x = cvRound(target.width * TARGET_MARGIN);
+        const int margin_y = cvRound(target.height * TARGET_MARGIN);
+        const cv::Rect padded(target.x - margin_x, target.y - margin_y,
+                              target.width + 2 * margin_x,
+                              target.height + 2 * margin_y);
+        return cv::Rect(cvFloor(padded.x * DOWNSCALE),
+                        cvFloor(padded.y * DOWNSCALE),
+                        cvCeil(padded.width * DOWNSCALE),
+                        cvCeil(padded.height * DOWNSCALE));
+    }
+
+    static float median(std::vector<float> &values) {
+        auto middle = values.begin() + values.size() / 2;
+        std::nth_element(values.begin(), middle, values.end());
+        return *middle;
+    }
+
+    cv::Mat small;
+    cv::Mat gray;
+    cv::Mat previous;
+    cv::Mat mask;
+    std::vector<cv::Point2f> corners;
+    std::vector<cv::Point2f> followed;
+    std::vector<cv::Point2f> kept;
+    std::vector<unsigned char> status;
+    std::vector<float> errors;
+    std::vector<float> dx;
+    std::vector<float> dy;
+};
+
+#endif
@@ -0,0 +1,314 @@
+#ifndef EVALUATION_HPP
+#define EVALUATION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Thresholds used for the OTB style precision and success plots
+const int PRECISION_MAX_ERROR = 50;
+const int PRECISION_REPORT_ERROR = 20;
+const int SUCCESS_STEPS = 20;
+
+/**
+ * @brief The raw per-frame results of running the tracker over one clip.
+ */
+struct ClipResult {
+    std::string name;
+    // Frames the tracker was updated on
+    int frames = 0;
+    // Total time spent in `tracker->update`, in seconds
+    double update_time = 0;
+    // Number of frames where `rocCheck` reported an unsafe rate of change
+    int roc_trips = 0;
+    // Number of frames where `tracker->update` reported a failure
+    int failures = 0;
+    // Distance between the predicted and ground truth centres, per frame
+    std::vector<double> centre_errors;
+    // Intersection over union of the predicted and ground truth boxes
+    std::vector<double> overlaps;
+};
+
+/**
+ * @brief The summary numbers for one clip, or for a whole run.
+ */
+struct Scorecard {
+    int frames = 0;
+    double fps = 0;
+    double precision = 0;
+    double auc = 0;
+    double roc_trip_rate = 0;
+    double failure_rate = 0;
+    std::vector<double> precision_curve;
+    std::vector<double> success_curve;
+};
+
+/**
+ * @brief Load ground truth annotations, one `x,y,w,h` box per frame. Commas,
+ * tabs and spaces are all accepted as separators.
+ *
+ * @param   path    The annotation file
+ * @return          The boxes, a zero sized box marks a frame without a target
+ */
+inline std::vector<cv::Rect2d> loadGroundTruth(const std::string &path) {
+    std::vector<cv::Rect2d> boxes;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        for (char &c : line) {
+            if (c == ',' || c == '\t') {
+                c = ' ';
+            }
+        }
+        std::istringstream fields(line);
+        cv::Rect2d box;
+        if (fields >> box.x >> box.y >> box.width >> box.height) {
+            boxes.push_back(box);
+        } else if (!line.empty()) {
+            // Keep frame numbering aligned for unreadable (e.g. NaN) lines
+            boxes.push_back(cv::Rect2d());
+        }
+    }
+    return boxes;
+}
+
+/**
+ * @brief Distance between the centres of two boxes.
+ */
+inline double centreError(const cv::Rect2d &a, const cv::Rect2d &b) {
+    const double dx = (a.x + a.width / 2) - (b.x + b.width / 2);
+    const double dy = (a.y + a.height / 2) - (b.y + b.height / 2);
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+/**
+ * @brief Intersection over union of two boxes.
+ */
+inline double overlap(const cv::Rect2d &a, const cv::Rect2d &b) {
+    const double intersection = (a & b).area();
+    const double union_area = a.area() + b.area() - intersection;
+    return union_area > 0 ? intersection / union_area : 0;
+}
+
+/**
+ * @brief Fraction of frames whose centre error is within each threshold from
+ * 0 to `PRECISION_MAX_ERROR` pixels.
+ */
+inline std::vector<double> precisionCurve(const std::vector<double> &errors) {
+    std::vector<double> curve(PRECISION_MAX_ERROR + 1, 0);
+    if (errors.empty()) {
+        return curve;
+    }
+    for (int t = 0; t <= PRECISION_MAX_ERROR; t++) {
+        int within = 0;
+        for (double e : errors) {
+            within += e <= t;
+        }
+        curve[t] = static_cast<double>(within) / errors.size();
+    }
+    return curve;
+}
+
+/**
+ * @brief Fraction of frames whose overlap is above each threshold from 0 to 1
+ * in `SUCCESS_STEPS` steps.
+ */
+inline std::vector<double> successCurve(const std::vector<double> &overlaps) {
+    std::vector<double> curve(SUCCESS_STEPS + 1, 0);
+    if (overlaps.empty()) {
+        return curve;
+    }
+    for (int t = 0; t <= SUCCESS_STEPS; t++) {
+        const double threshold = static_cast<double>(t) / SUCCESS_STEPS;
+        int above = 0;
+        for (double o : overlaps) {
+            above += o > threshold;
+        }
+        curve[t] = static_cast<double>(above) / overlaps.size();
+    }
+    return curve;
+}
+
+/**
+ * @brief Summarise a single clip.
+ */
+inline Scorecard score(const ClipResult &result) {
+    Scorecard card;
+    card.frames = result.frames;
+    card.fps = result.update_time > 0 ? result.frames / result.update_time : 0;
+    card.precision_curve = precisionCurve(result.centre_errors);
+    card.success_curve = successCurve(result.overlaps);
+    card.precision = card.precision_curve[PRECISION_REPORT_ERROR];
+    double auc = 0;
+    for (double s : card.success_curve) {
+        auc += s;
+    }
+    card.auc = auc / card.success_curve.size();
+    if (result.frames > 0) {
+        card.roc_trip_rate = static_cast<double>(result.roc_trips) /
+                             result.frames;
+        card.failure_rate = static_cast<double>(result.failures) /
+                            result.frames;
+    }
+    return card;
+}
+
+/**
+ * @brief Summarise a whole run. Curves are averaged over clips, as in the OTB
+ * benchmark, so that long clips do not dominate the result.
+ */
+inline Scorecard score(const std::vector<ClipResult> &results) {
+    Scorecard total;
+    total.precision_curve.assign(PRECISION_MAX_ERROR + 1, 0);
+    total.success_curve.assign(SUCCESS_STEPS + 1, 0);
+    if (results.empty()) {
+        return total;
+    }
+    double update_time = 0;
+    int roc_trips = 0;
+    int failures = 0;
+    for (const ClipResult &result : results) {
+        const Scorecard card = score(result);
+        for (size_t i = 0; i < total.precision_curve.size(); i++) {
+            total.precision_curve[i] +=
+                card.precision_curve[i] / results.size();
+        }
+        for (size_t i = 0; i < total.success_curve.size(); i++) {
+            total.success_curve[i] += card.success_curve[i] / results.size();
+        }
+        total.precision += card.precision / results.size();
+        total.auc += card.auc / results.size();
+        total.frames += result.frames;
+        update_time += result.update_time;
+        roc_trips += result.roc_trips;
+        failures += result.failures;
+    }
+    if (update_time > 0) {
+        total.fps = total.frames / update_time;
+    }
+    if (total.frames > 0) {
+        total.roc_trip_rate = static_cast<double>(roc_trips) / total.frames;
+        total.failure_rate = static_cast<double>(failures) / total.frames;
+    }
+    return total;
+}
+
+/**
+ * @brief Write a scorecard as a single report line, `key value` pairs so that
+ * reports from different runs can be diffed and parsed back.
+ */
+inline void writeScore(std::ostream &out, const std::string &label,
+                       const std::string &name, const Scorecard &card) {
+    // Quoted, so a name with spaces reads back as one field
+    out << label << " " << std::quoted(name) << std::fixed
+        << std::setprecision(4) << " frames " << card.frames << " fps "
+        << card.fps << " precision " << card.precision << " auc " << card.auc
+        << " roc_trip_rate " << card.roc_trip_rate << " failure_rate "
+        << card.failure_rate << "\n";
+}
+
+/**
+ * @brief Write the full report for a run, clips sorted by name.
+ *
+ * @param   out         The stream to write to
+ * @param   tracker     The name of the tracker that was evaluated
+ * @param   results     The results for every clip in the run
+ */
+inline void writeReport(std::ostream &out, const std::string &tracker,
+                        std::vector<ClipResult> results) {
+    std::sort(results.begin(), results.end(),
+              [](const ClipResult &a, const ClipResult &b) {
+                  return a.name < b.name;
+              });
+    out << "# tracking-eval report, tracker " << tracker << "\n";
+    for (const ClipResult &result : results) {
+        writeScore(out, "clip", result.name, score(result));
+    }
+    const Scorecard total = score(results);
+    writeScore(out, "overall", "all", total);
+    out << "precision_curve" << std::fixed << std::setprecision(4);
+    for (double p : total.precision_curve) {
+        out << " " << p;
+    }
+    out << "\nsuccess_curve";
+    for (double s : total.success_curve) {
+        out << " " << s;
+    }
+    out << "\n";
+}
+
+/**
+ * @brief Read the `clip` and `overall` lines of a report written by
+ * `writeReport`.
+ *
+ * @param   path    The report file
+ * @return          The metrics of each line, keyed by clip name then metric
+ */
+inline std::map<std::string, std::map<std::string, double>>
+readReport(const std::string &path) {
+    std::map<std::string, std::map<std::string, double>> report;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string label, name;
+        // Names are quoted, older reports' unquoted names read as before
+        fields >> label >> std::quoted(name);
+        if (label != "clip" && label != "overall") {
+            continue;
+        }
+        std::string key;
+        double value;
+        while (fields >> key >> value) {
+            report[name][key] = value;
+        }
+    }
+    return report;
+}
+
+/**
+ * @brief Print the difference between a run and a stored baseline report.
+ *
+ * @param   out         The stream to write to
+ * @param   baseline    The baseline, as read by `readReport`
+ * @param   current     The current run, as read by `readReport`
+ */
+inline void compareReports(
+    std::ostream &out,
+    const std::map<std::string, std::map<std::string, double>> &baseline,
+    const std::map<std::string, std::map<std::string, double>> &current) {
+    out << std::fixed << std::setprecision(4);
+    for (const auto &[name, metrics] : current) {
+        const auto base = baseline.find(name);
+        if (base == baseline.end()) {
+            out << name << ": not in baseline\n";
+            continue;
+        }
+        out << name << ":";
+        for (const auto &[key, value] : metrics) {
+            const auto old_value = base->second.find(key);
+            if (old_value == base->second.end()) {
+                continue;
+            }
+            const double delta = value - old_value->second;
+            out << " " << key << " " << value << " (" << std::showpos << delta
+                << std::noshowpos << ")";
+        }
+        out << "\n";
+    }
+    for (const auto &[name, metrics] : baseline) {
+        if (current.find(name) == current.end()) {
+            out << name << ": missing from this run\n";
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Stands in for one or more Tellos on this machine, for running
+ * `tracking-drone` with several sessions without drones. Every port answers
+ * each command with `ok`, except `rc` which the drone never acknowledges.
+ *
+ * ./fake-tello PORT...
+ * ./tracking-drone --drone 127.0.0.1:PORT --stream CLIP ...
+ */
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cout << "Incorrect usage, please use: ./fake-tello PORT..."
+                  << std::endl;
+        return 0;
+    }
+
+    std::vector<pollfd> sockets;
+    std::vector<int> ports;
+    for (int i = 1; i < argc; i++) {
+        const int port = std::atoi(argv[i]);
+        const int socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (socket_fd < 0 ||
+            bind(socket_fd, reinterpret_cast<sockaddr *>(&address),
+                 sizeof(address)) < 0) {
+            std::cout << "cannot bind port " << port << std::endl;
+            return 0;
+        }
+        sockets.push_back({socket_fd, POLLIN, 0});
+        ports.push_back(port);
+        std::cout << "Fake Tello listening on " << port << std::endl;
+    }
+
+    while (poll(sockets.data(), sockets.size(), -1) > 0) {
+        for (size_t i = 0; i < sockets.size(); i++) {
+            if (!(sockets[i].revents & POLLIN)) {
+                continue;
+            }
+            char buffer[256];
+            sockaddr_in sender{};
+            socklen_t sender_size = sizeof(sender);
+            const ssize_t length =
+                recvfrom(sockets[i].fd, buffer, sizeof(buffer), 0,
+                         reinterpret_cast<sockaddr *>(&sender), &sender_size);
+            if (length <= 0) {
+                continue;
+            }
+            const std::string command(buffer, length);
+            std::cout << ports[i] << ": " << command << std::endl;
+            if (command.compare(0, 3, "rc ") == 0) {
+                continue;
+            }
+            const std::string response = "ok";
+            sendto(sockets[i].fd, response.data(), response.size(), 0,
+                   reinterpret_cast<sockaddr *>(&sender), sender_size);
+        }
+    }
+}
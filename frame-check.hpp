@@ -0,0 +1,162 @@
+#ifndef FRAME_CHECK_HPP
+#define FRAME_CHECK_HPP
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+/**
+ * @brief What `FrameCheck` made of a frame.
+ */
+enum class FrameVerdict { Good, Duplicate, Corrupt };
+
+inline const char *frameVerdictName(FrameVerdict verdict) {
+    switch (verdict) {
+    case FrameVerdict::Duplicate:
+        return "duplicate";
+    case FrameVerdict::Corrupt:
+        return "corrupt";
+    default:
+        return "good";
+    }
+}
+
+/**
+ * @brief Spots frames not worth tracking in a decoded H.264 stream: repeats
+ * of the previous frame, and frames damaged by lost packets, which the Tello
+ * decodes with flat grey macroblocks or smeared blocks.
+ *
+ * The frame is reduced to a grey half size copy and then to the mean and
+ * variance of each 16x16 macroblock, all with whole-image OpenCV operations.
+ * - A frame whose block means all match those of the last frame passed to
+ *   within `DUPLICATE_DIFFERENCE` is a duplicate.
+ * - A frame where more than `GREY_SHARE` of the blocks are flat mid grey,
+ *   and were not on the last good frame, is corrupt.
+ * - A frame whose differences across block edges average more than
+ *   `BLOCKINESS` times those elsewhere is corrupt.
+ *
+ * A scene which really does look like this, such as a grey wall filling the
+ * view, would be rejected for good, so after `MAX_REJECTED` rejections in a
+ * row the frame is passed regardless.
+ */
+class FrameCheck {
+  public:
+    // H.264 macroblock side, in full size pixels
+    static constexpr int BLOCK = 16;
+    // Mean difference of the block means, in grey levels
+    static constexpr double DUPLICATE_DIFFERENCE = 0.3;
+    // Variance in grey levels squared below which a block is flat, and how
+    // near mid grey a flat block has to be to count as missing
+    static constexpr double FLAT_VARIANCE = 4;
+    static constexpr double GREY_RANGE = 12;
+    static constexpr double GREY_SHARE = 0.05;
+    static constexpr double BLOCKINESS = 2.5;
+    // Half a second at 30fps
+    static constexpr int MAX_REJECTED = 15;
+
+    FrameVerdict check(const cv::Mat &frame) {
+        if (frame.channels() == 3) {
+            cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        } else {
+            frame.copyTo(gray);
+        }
+        const cv::Size blocks(gray.cols / BLOCK, gray.rows / BLOCK);
+        if (blocks.area() == 0) {
+            return FrameVerdict::Good;
+        }
+        cv::resize(gray, half, cv::Size(gray.cols / 2, gray.rows / 2), 0, 0,
+                   cv::INTER_AREA);
+        half.convertTo(values, CV_32F);
+        cv::multiply(values, values, squares);
+        // Area interpolation at a whole ratio is the exact block mean
+        cv::resize(values, means, blocks, 0, 0, cv::INTER_AREA);
+        cv::resize(squares, mean_squares, blocks, 0, 0, cv::INTER_AREA);
+
+        // Compared with the last frame passed rather than the last frame, so
+        // a scene drifting slowly over rejected frames is still passed
+        FrameVerdict verdict = FrameVerdict::Good;
+        if (good_means.size() == means.size() &&
+            cv::norm(means, good_means, cv::NORM_L1) / blocks.area() <
+                DUPLICATE_DIFFERENCE) {
+            verdict = FrameVerdict::Duplicate;
+        }
+
+        // Flat mid grey blocks
+        cv::multiply(means, means, squares);
+        cv::subtract(mean_squares, squares, variance);
+        cv::compare(variance, FLAT_VARIANCE, flat, cv::CMP_LT);
+        cv::absdiff(means, cv::Scalar::all(128), variance);
+        cv::compare(variance, GREY_RANGE, grey, cv::CMP_LT);
+        cv::bitwise_and(grey, flat, grey);
+        if (verdict == FrameVerdict::Good && good_grey.size() == grey.size()) {
+            cv::bitwise_not(good_grey, flat);
+            cv::bitwise_and(grey, flat, flat);
+            if (cv::countNonZero(flat) > GREY_SHARE * blocks.area() ||
+                blockiness() > BLOCKINESS) {
+                verdict = FrameVerdict::Corrupt;
+            }
+        }
+
+        if (verdict != FrameVerdict::Good && ++rejected <= MAX_REJECTED) {
+            return verdict;
+        }
+        rejected = 0;
+        cv::swap(means, good_means);
+        cv::swap(grey, good_grey);
+        return FrameVerdict::Good;
+    }
+
+  private:
+    // Mean difference across the edges of the 8x8 half size blocks over the
+    // mean difference between the pixels inside them, in both directions
+    double blockiness() {
+        double edges = 0;
+        double inside = 0;
+        int edge_count = 0;
+        int inside_count = 0;
+        for (int axis = 0; axis < 2; axis++) {
+            // Column differences summed down the image, then row differences
+            // summed across it
+            const cv::Mat a = axis == 0 ? half.colRange(1, half.cols)
+                                        : half.rowRange(1, half.rows);
+            const cv::Mat b = axis == 0 ? half.colRange(0, half.cols - 1)
+                                        : half.rowRange(0, half.rows - 1);
+            cv::absdiff(a, b, differences);
+            cv::reduce(differences, sums, axis == 0 ? 0 : 1, cv::REDUCE_SUM,
+                       CV_32F);
+            const float *sum = sums.ptr<float>();
+            for (int i = 0; i < static_cast<int>(sums.total()); i++) {
+                // Difference `i` is between pixels `i` and `i + 1`
+                if ((i + 1) % (BLOCK / 2) == 0) {
+                    edges += sum[i];
+                    edge_count++;
+                } else {
+                    inside += sum[i];
+                    inside_count++;
+                }
+            }
+        }
+        if (edge_count == 0 || inside <= 0) {
+            return 0;
+        }
+        return (edges / edge_count) / (inside / inside_count);
+    }
+
+    cv::Mat gray;
+    cv::Mat half;
+    cv::Mat values;
+    cv::Mat squares;
+    cv::Mat means;
+    cv::Mat mean_squares;
+    cv::Mat variance;
+    cv::Mat flat;
+    cv::Mat grey;
+    // Block means and flat grey blocks of the last frame passed, so a grey
+    // part of the scene is not taken for damage
+    cv::Mat good_means;
+    cv::Mat good_grey;
+    cv::Mat differences;
+    cv::Mat sums;
+    int rejected = 0;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef FRAME_POOL_HPP
+#define FRAME_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include <opencv2/core.hpp>
+
+/**
+ * @brief A fixed set of preallocated frame buffers. Stages borrow a buffer
+ * with `acquire` and it goes back to the pool when the last `Lease` on it is
+ * destroyed, so after start up no frame memory is allocated or freed.
+ *
+ * Acquiring and releasing are lock-free and safe from any thread.
+ */
+class FramePool {
+    struct Slot {
+        cv::Mat buffer;
+        std::atomic<int> users{0};
+    };
+
+  public:
+    /**
+     * @brief Shared ownership of one pool buffer. Copying a lease adds a user,
+     * the buffer is returned once every copy has been destroyed.
+     */
+    class Lease {
+      public:
+        Lease() = default;
+        Lease(const Lease &other) : slot(other.slot) {
+            if (slot) {
+                slot->users++;
+            }
+        }
+        Lease(Lease &&other) noexcept : slot(other.slot) {
+            other.slot = nullptr;
+        }
+        Lease &operator=(Lease other) noexcept {
+            std::swap(slot, other.slot);
+            return *this;
+        }
+        ~Lease() { release(); }
+
+        /**
+         * @brief Give up this user's share of the buffer.
+         */
+        void release() {
+            if (slot) {
+                slot->users.fetch_sub(1, std::memory_order_acq_rel);
+                slot = nullptr;
+            }
+        }
+
+        /**
+         * @brief A header for the buffer. Copying a header does not allocate,
+         * and reading or retrieving a frame of the same size and type into it
+         * writes straight into the pool's memory.
+         */
+        cv::Mat mat() const { return slot ? slot->buffer : cv::Mat(); }
+
+        explicit operator bool() const { return slot != nullptr; }
+
+      private:
+        friend class FramePool;
+        explicit Lease(Slot *slot) : slot(slot) {}
+        Slot *slot = nullptr;
+    };
+
+    /**
+     * @brief Allocate every buffer up front.
+     *
+     * @param   count   The number of buffers, enough for every frame that can
+     * be in flight at once
+     * @param   size    The frame size
+     * @param   type    The frame type, e.g. `CV_8UC3`
+     */
+    FramePool(size_t count, cv::Size size, int type)
+        : slots(new Slot[count]), count(count) {
+        for (size_t i = 0; i < count; i++) {
+            slots[i].buffer.create(size, type);
+        }
+    }
+
+    /**
+     * @brief Borrow a free buffer.
+     *
+     * @return  A lease on the buffer, or an empty lease if every buffer is in
+     * use, in which case the caller has to allocate its own
+     */
+    Lease acquire() {
+        const size_t start = next.fetch_add(1, std::memory_order_relaxed);
+        for (size_t i = 0; i < count; i++) {
+            Slot &slot = slots[(start + i) % count];
+            int expected = 0;
+            if (slot.users.compare_exchange_strong(expected, 1,
+                                                   std::memory_order_acq_rel)) {
+                return Lease(&slot);
+            }
+        }
+        exhausted++;
+        return Lease();
+    }
+
+    /**
+     * @brief Number of buffers not currently lent out.
+     */
+    size_t available() const {
+        size_t free = 0;
+        for (size_t i = 0; i < count; i++) {
+            free += slots[i].users.load(std::memory_order_relaxed) == 0;
+        }
+        return free;
+    }
+
+    size_t size() const { return count; }
+
+    // Number of times `acquire` found no free buffer
+    std::atomic<std::uint64_t> exhausted{0};
+
+  private:
+    std::unique_ptr<Slot[]> slots;
+    size_t count;
+    // Where the next search starts, spreads buffers round the pool
+    std::atomic<size_t> next{0};
+};
+
+/**
+ * @brief Wraps OpenCV's default allocator and counts every `cv::Mat` data
+ * allocation made anywhere in the process, including inside OpenCV.
+ *
+ * Install with `cv::Mat::setDefaultAllocator` before any frames are created.
+ */
+class CountingMatAllocator : public cv::MatAllocator {
+  public:
+    explicit CountingMatAllocator(cv::MatAllocator *wrapped)
+        : wrapped(wrapped) {}
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data,
+                           size_t *step, cv::AccessFlag flags,
+                           cv::UMatUsageFlags usageFlags) const override {
+        if (!data) {
+            allocations++;
+        }
+        return wrapped->allocate(dims, sizes, type, data, step, flags,
+                                 usageFlags);
+    }
+
+    bool allocate(cv::UMatData *data, cv::AccessFlag accessflags,
+                  cv::UMatUsageFlags usageFlags) const override {
+        return wrapped->allocate(data, accessflags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData *data) const override {
+        wrapped->deallocate(data);
+    }
+
+    std::uint64_t count() const { return allocations.load(); }
+
+  private:
+    cv::MatAllocator *wrapped;
+    mutable std::atomic<std::uint64_t> allocations{0};
+};
+
+#endif
@@ -0,0 +1,365 @@
+#ifndef FRAME_SOURCE_HPP
+#define FRAME_SOURCE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "recorder.hpp"
+
+// The Tello's stream resolution, which the controller's constants assume
+const cv::Size STREAM_SIZE(960, 720);
+
+/**
+ * @brief The four characters of a fourcc code, e.g. `MJPG`.
+ */
+inline std::string fourccName(int fourcc) {
+    if (fourcc <= 0) {
+        return "unknown";
+    }
+    std::string name;
+    for (int i = 0; i < 4; i++) {
+        const char c = static_cast<char>((fourcc >> (8 * i)) & 0xff);
+        name += std::isprint(static_cast<unsigned char>(c)) ? c : ' ';
+    }
+    return name;
+}
+
+/**
+ * @brief What a source delivers, as agreed with it when opened.
+ */
+struct SourceFormat {
+    // `v4l2`, `stream`, `file`, `images`, `log` or `sim`
+    std::string kind;
+    // Size and pixel format of the frames as the source produces them, and
+    // the rate it claims
+    cv::Size size;
+    std::string pixel_format;
+    double fps = 30;
+    // Frames are resized to `STREAM_SIZE` after capture, because the source
+    // could not produce that size itself
+    bool resized = false;
+};
+
+inline std::ostream &operator<<(std::ostream &out,
+                                const SourceFormat &format) {
+    out << format.kind << " " << format.size.width << "x"
+        << format.size.height << " " << format.pixel_format << " "
+        << format.fps << "fps";
+    if (format.resized) {
+        out << ", resized to " << STREAM_SIZE.width << "x"
+            << STREAM_SIZE.height;
+    }
+    return out;
+}
+
+/**
+ * @brief Where a session's frames come from: the drone's stream, a camera, a
+ * file, a frame log or a simulated drone's camera. Only the ingest stage reads
+ * from it once the session is running.
+ */
+class FrameSource {
+  public:
+    virtual ~FrameSource() = default;
+
+    /**
+     * @brief Read the next frame, into `frame`'s buffer when it already has
+     * the right size and type. Sources which hold their frames in memory
+     * point `frame` at them instead, which must then not be written to.
+     *
+     * @return  `false` at the end of the stream
+     */
+    virtual bool read(cv::Mat &frame) = 0;
+    virtual void release() {}
+
+    const SourceFormat &format() const { return source_format; }
+    double fps() const { return source_format.fps; }
+
+  protected:
+    SourceFormat source_format;
+};
+
+/**
+ * @brief A V4L2 camera, by index or device path. The camera is asked for the
+ * drone's 960x720 at 30fps directly, as MJPG first, which most UVC cameras
+ * need for that size and rate and some scale to in hardware, then as YUYV.
+ * Only if neither is given are frames resized, after capture.
+ */
+class CameraSource : public FrameSource {
+  public:
+    bool open(const std::string &device) {
+        const bool index =
+            std::all_of(device.begin(), device.end(), [](char c) {
+                return std::isdigit(static_cast<unsigned char>(c));
+            });
+        if (index) {
+            cap.open(std::stoi(device), cv::CAP_V4L2);
+        } else {
+            cap.open(device, cv::CAP_V4L2);
+        }
+        if (!cap.isOpened()) {
+            return false;
+        }
+        const int formats[] = {cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
+                               cv::VideoWriter::fourcc('Y', 'U', 'Y', 'V')};
+        bool native = false;
+        for (int fourcc : formats) {
+            native = request(fourcc);
+            if (native) {
+                break;
+            }
+        }
+        if (!native) {
+            // Compressed frames leave the most USB bandwidth at other sizes
+            request(formats[0]);
+        }
+        source_format.kind = "v4l2";
+        source_format.size = capturedSize();
+        source_format.pixel_format =
+            fourccName(static_cast<int>(cap.get(cv::CAP_PROP_FOURCC)));
+        const double rate = cap.get(cv::CAP_PROP_FPS);
+        source_format.fps = rate > 0 ? rate : 30;
+        source_format.resized = source_format.size != STREAM_SIZE;
+        return true;
+    }
+
+    bool read(cv::Mat &frame) override {
+        if (!source_format.resized) {
+            return cap.read(frame);
+        }
+        if (!cap.read(raw)) {
+            return false;
+        }
+        cv::resize(raw, frame, STREAM_SIZE, 0, 0, cv::INTER_AREA);
+        return true;
+    }
+
+    void release() override { cap.release(); }
+
+  private:
+    // Ask for a pixel format at the drone's size and rate, returns whether
+    // the camera agreed to the size
+    bool request(int fourcc) {
+        cap.set(cv::CAP_PROP_FOURCC, fourcc);
+        cap.set(cv::CAP_PROP_FRAME_WIDTH, STREAM_SIZE.width);
+        cap.set(cv::CAP_PROP_FRAME_HEIGHT, STREAM_SIZE.height);
+        cap.set(cv::CAP_PROP_FPS, 30);
+        return capturedSize() == STREAM_SIZE;
+    }
+
+    cv::Size capturedSize() const {
+        return cv::Size(static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH)),
+                        static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT)));
+    }
+
+    cv::VideoCapture cap;
+    // The camera's own frame, before resizing
+    cv::Mat raw;
+};
+
+/**
+ * @brief A video file or network stream decoded by FFmpeg, including the
+ * Tello's H.264 stream, which is already 960x720. Frames are used at the size
+ * they are decoded at.
+ */
+class CaptureSource : public FrameSource {
+  public:
+    bool open(const std::string &url) {
+        cap.open(url, cv::CAP_FFMPEG);
+        if (!cap.isOpened()) {
+            return false;
+        }
+        source_format.kind =
+            url.find("://") != std::string::npos ? "stream" : "file";
+        source_format.size =
+            cv::Size(static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH)),
+                     static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT)));
+        source_format.pixel_format =
+            fourccName(static_cast<int>(cap.get(cv::CAP_PROP_FOURCC)));
+        const double rate = cap.get(cv::CAP_PROP_FPS);
+        source_format.fps = rate > 0 ? rate : 30;
+        return true;
+    }
+
+    bool read(cv::Mat &frame) override { return cap.read(frame); }
+
+    void release() override { cap.release(); }
+
+  private:
+    cv::VideoCapture cap;
+};
+
+/**
+ * @brief A directory of images, read in name order, e.g. frames exported
+ * from another tool or an evaluation dataset, taken to be 30fps.
+ */
+class ImageSequenceSource : public FrameSource {
+  public:
+    bool open(const std::string &directory) {
+        std::error_code error;
+        for (const auto &entry :
+             std::filesystem::directory_iterator(directory, error)) {
+            std::string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(),
+                           extension.begin(), [](unsigned char c) {
+                               return std::tolower(c);
+                           });
+            if (extension == ".png" || extension == ".jpg" ||
+                extension == ".jpeg" || extension == ".bmp") {
+                paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+        if (paths.empty()) {
+            return false;
+        }
+        const cv::Mat first = cv::imread(paths.front());
+        if (first.empty()) {
+            return false;
+        }
+        source_format.kind = "images";
+        source_format.size = first.size();
+        source_format.pixel_format =
+            std::filesystem::path(paths.front()).extension().string().substr(1);
+        return true;
+    }
+
+    bool read(cv::Mat &frame) override {
+        if (next >= paths.size()) {
+            return false;
+        }
+        cv::imread(paths[next++]).copyTo(frame);
+        return !frame.empty();
+    }
+
+  private:
+    std::vector<std::string> paths;
+    size_t next = 0;
+};
+
+/**
+ * @brief A frame log recorded with `--codec log`, memory mapped. Frames are
+ * handed out as headers pointing into the mapping, so nothing is decoded or
+ * copied and the kernel pages the file in ahead of the reader. The mapping
+ * lasts as long as the source, as frames still being recorded point into it
+ * after `release`.
+ */
+class FrameLogSource : public FrameSource {
+  public:
+    ~FrameLogSource() override {
+        if (data) {
+            munmap(data, length);
+        }
+    }
+
+    bool open(const std::string &path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info {};
+        if (fstat(fd, &info) == 0 &&
+            static_cast<size_t>(info.st_size) >= sizeof(FrameLogHeader)) {
+            length = info.st_size;
+            void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            data = mapped == MAP_FAILED ? nullptr
+                                        : static_cast<unsigned char *>(mapped);
+        }
+        ::close(fd);
+        if (!data) {
+            return false;
+        }
+        madvise(data, length, MADV_SEQUENTIAL);
+
+        const auto *header = reinterpret_cast<const FrameLogHeader *>(data);
+        if (!header->valid()) {
+            munmap(data, length);
+            data = nullptr;
+            return false;
+        }
+        type = header->type;
+        source_format.kind = "log";
+        source_format.size = cv::Size(header->width, header->height);
+        source_format.pixel_format = CV_MAT_CN(type) == 1 ? "GRAY" : "BGR";
+        source_format.fps = header->fps > 0 ? header->fps : 30;
+        frame_bytes = source_format.size.area() * CV_ELEM_SIZE(type);
+        offset = sizeof(FrameLogHeader);
+        return true;
+    }
+
+    bool read(cv::Mat &frame) override {
+        if (!data || offset + frame_bytes > length) {
+            return false;
+        }
+        // Read only memory, nothing downstream writes to `frame`
+        frame = cv::Mat(source_format.size, type, data + offset);
+        offset += frame_bytes;
+        return true;
+    }
+
+  private:
+    unsigned char *data = nullptr;
+    size_t length = 0;
+    size_t offset = 0;
+    size_t frame_bytes = 0;
+    int type = CV_8UC3;
+};
+
+/**
+ * @brief Open the source a URL names:
+ * - a camera index (`0`) or device (`/dev/video0`), through V4L2
+ * - a directory of images
+ * - a frame log, `.frames`
+ * - anything else, a file or a network stream such as the Tello's
+ *   `udp://0.0.0.0:11111`, through FFmpeg
+ *
+ * @return  The open source, or `nullptr` if it could not be opened
+ */
+inline std::unique_ptr<FrameSource> openFrameSource(const std::string &url) {
+    const bool index =
+        !url.empty() && std::all_of(url.begin(), url.end(), [](char c) {
+            return std::isdigit(static_cast<unsigned char>(c));
+        });
+    if (index || url.rfind("/dev/video", 0) == 0) {
+        auto camera = std::make_unique<CameraSource>();
+        if (camera->open(url)) {
+            return camera;
+        }
+        return nullptr;
+    }
+    if (std::filesystem::is_directory(url)) {
+        auto images = std::make_unique<ImageSequenceSource>();
+        if (images->open(url)) {
+            return images;
+        }
+        return nullptr;
+    }
+    if (std::filesystem::path(url).extension() == ".frames") {
+        auto log = std::make_unique<FrameLogSource>();
+        if (log->open(url)) {
+            return log;
+        }
+        return nullptr;
+    }
+    auto capture = std::make_unique<CaptureSource>();
+    if (capture->open(url)) {
+        return capture;
+    }
+    return nullptr;
+}
+
+#endif
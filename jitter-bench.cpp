@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "thread-policy.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// The Tello's stream resolution, the loop and the load work on frames of it
+const cv::Size STREAM_SIZE(960, 720);
+// The ROI the loop works on each period, as the tracker would
+const cv::Rect LOOP_ROI(380, 260, 200, 200);
+
+/**
+ * @brief Mean, standard deviation, 50th, 99th and 99.9th percentile and
+ * maximum of some times.
+ */
+std::string summary(std::vector<double> times, const std::string &unit) {
+    if (times.empty()) {
+        return "none";
+    }
+    double total = 0;
+    for (double time : times) {
+        total += time;
+    }
+    const double mean = total / times.size();
+    double squares = 0;
+    for (double time : times) {
+        squares += (time - mean) * (time - mean);
+    }
+    std::sort(times.begin(), times.end());
+    std::ostringstream out;
+    out << "mean " << mean << unit << " sd "
+        << std::sqrt(squares / times.size()) << unit << " p50 "
+        << times[times.size() / 2] << unit << " p99 "
+        << times[times.size() * 99 / 100] << unit << " p99.9 "
+        << times[times.size() * 999 / 1000] << unit << " max " << times.back()
+        << unit;
+    return out.str();
+}
+
+/**
+ * @brief Keep a core busy as the other stages would, with OpenCV work which
+ * itself runs on OpenCV's thread pool.
+ */
+void load(const std::atomic<bool> &running, const ThreadPolicy &policy) {
+    std::string error;
+    policy.apply(error);
+    cv::Mat frame(STREAM_SIZE, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat blurred;
+    while (running) {
+        cv::GaussianBlur(frame, blurred, cv::Size(15, 15), 0);
+    }
+}
+
+/**
+ * @brief Run a periodic loop under load and print how evenly it ran.
+ *
+ * @param   name        What is being measured
+ * @param   policy      The loop thread's scheduling
+ * @param   load_policy The load threads' scheduling
+ * @param   cv_threads  OpenCV's thread count, -1 for its default
+ * @param   loads       Number of load threads
+ * @param   period      The loop period
+ * @param   seconds     How long to run for
+ */
+void bench(const std::string &name, const ThreadPolicy &policy,
+           const ThreadPolicy &load_policy, int cv_threads, int loads,
+           std::chrono::microseconds period, double seconds) {
+    const int default_threads = cv::getNumThreads();
+    if (cv_threads >= 0) {
+        cv::setNumThreads(cv_threads);
+    }
+    std::atomic<bool> running{true};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < loads; i++) {
+        threads.emplace_back(load, std::cref(running), std::cref(load_policy));
+    }
+
+    // The loop runs on a thread of its own, as the stages do
+    std::vector<double> periods;
+    std::vector<double> lateness;
+    std::vector<double> work;
+    std::string error;
+    std::thread loop([&]() {
+        policy.apply(error);
+        cv::Mat frame(STREAM_SIZE, CV_8UC3);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+        cv::Mat gray;
+        cv::Mat blurred;
+        const auto iterations =
+            static_cast<size_t>(seconds * 1e6 / period.count());
+        periods.reserve(iterations);
+        lateness.reserve(iterations);
+        work.reserve(iterations);
+        auto next = Clock::now() + period;
+        auto last = Clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            std::this_thread::sleep_until(next);
+            const auto woke = Clock::now();
+            cv::cvtColor(frame(LOOP_ROI), gray, cv::COLOR_BGR2GRAY);
+            cv::GaussianBlur(gray, blurred, cv::Size(9, 9), 0);
+            const auto done = Clock::now();
+            periods.push_back(
+                std::chrono::duration<double, std::milli>(woke - last)
+                    .count());
+            lateness.push_back(
+                std::chrono::duration<double, std::micro>(woke - next)
+                    .count());
+            work.push_back(
+                std::chrono::duration<double, std::micro>(done - woke)
+                    .count());
+            last = woke;
+            next += period;
+        }
+    });
+    loop.join();
+    running = false;
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    cv::setNumThreads(default_threads);
+
+    // The first period starts before the loop's first wake
+    periods.erase(periods.begin());
+    std::cout << name << " OpenCV threads "
+              << (cv_threads >= 0 ? cv_threads : default_threads);
+    if (!error.empty()) {
+        std::cout << ", not applied: " << error;
+    }
+    std::cout << std::endl;
+    std::cout << name << " period   " << summary(periods, "ms") << std::endl;
+    std::cout << name << " lateness " << summary(lateness, "us") << std::endl;
+    std::cout << name << " work     " << summary(work, "us") << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = 10;
+    double rate = 30;
+    ThreadPolicy policy;
+    int cv_threads = 1;
+    int loads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Check command line arguments and set variables based on these
+    bool valid = true;
+    for (int i = 1; i < argc && valid; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc) {
+            seconds = std::max(1.0, std::atof(argv[++i]));
+        } else if (arg == "--rate" && i + 1 < argc) {
+            rate = std::max(1.0, std::atof(argv[++i]));
+        } else if (arg == "--pin" && i + 1 < argc) {
+            valid = parseCpus(argv[++i], policy.cpus);
+        } else if (arg == "--fifo" && i + 1 < argc) {
+            policy.fifo = std::clamp(std::atoi(argv[++i]), 1, 99);
+        } else if (arg == "--nice" && i + 1 < argc) {
+            policy.nice = std::clamp(std::atoi(argv[++i]), -20, 19);
+        } else if (arg == "--cv-threads" && i + 1 < argc) {
+            cv_threads = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--load" && i + 1 < argc) {
+            loads = std::max(0, std::atoi(argv[++i]));
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        std::cout << "Incorrect usage, please use: ";
+        std::cout << "./jitter-bench [--seconds N] [--rate HZ] [--pin CPUS] "
+                     "[--fifo PRIORITY] [--nice N] [--cv-threads N] "
+                     "[--load N]"
+                  << std::endl;
+        return 0;
+    }
+
+    // Tuned, the load keeps off the loop's cores, as the other stages would
+    // be pinned away from control
+    ThreadPolicy load_policy;
+    if (!policy.cpus.empty()) {
+        const int cores = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < cores; cpu++) {
+            if (std::find(policy.cpus.begin(), policy.cpus.end(), cpu) ==
+                policy.cpus.end()) {
+                load_policy.cpus.push_back(cpu);
+            }
+        }
+    }
+    const auto period = std::chrono::microseconds(
+        static_cast<std::int64_t>(1e6 / rate));
+    std::cout << "Running a " << rate << "Hz loop for " << seconds
+              << "s against " << loads << " load thread(s)" << std::endl;
+    bench("default", ThreadPolicy(), ThreadPolicy(), -1, loads, period,
+          seconds);
+    bench("tuned  ", policy, load_policy, cv_threads, loads, period, seconds);
+}
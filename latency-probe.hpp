@@ -0,0 +1,378 @@
+#ifndef LATENCY_PROBE_HPP
+#define LATENCY_PROBE_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+/**
+ * @brief A frame identifier drawn as a grid of black and white cells inside a
+ * black border, large enough to be read back by a camera filming the screen.
+ *
+ * The grid holds a 24 bit identifier and an 8 bit check, so a misread is
+ * rejected rather than matched with the wrong frame. The camera is assumed to
+ * be roughly upright, perspective is corrected.
+ */
+class FrameStamp {
+  public:
+    // Data cells, and the cells including the border
+    static constexpr int COLS = 8;
+    static constexpr int ROWS = 4;
+    static constexpr int GRID_COLS = COLS + 2;
+    static constexpr int GRID_ROWS = ROWS + 2;
+    // Identifiers wrap around at this
+    static constexpr std::uint32_t ID_LIMIT = 1 << 24;
+
+    /**
+     * @brief Draw a stamp, with a white quiet zone of one cell around it.
+     *
+     * @param   image   The image to draw on
+     * @param   area    Where to draw, the stamp is centred in it
+     * @param   id      The identifier, modulo `ID_LIMIT`
+     */
+    static void draw(cv::Mat &image, const cv::Rect &area, std::uint32_t id) {
+        cv::rectangle(image, area, cv::Scalar::all(255), cv::FILLED);
+        const int cell = std::min(area.width / (GRID_COLS + 2),
+                                  area.height / (GRID_ROWS + 2));
+        const cv::Point origin(
+            area.x + (area.width - GRID_COLS * cell) / 2,
+            area.y + (area.height - GRID_ROWS * cell) / 2);
+        const std::uint32_t bits = encode(id);
+        for (int row = 0; row < GRID_ROWS; row++) {
+            for (int col = 0; col < GRID_COLS; col++) {
+                const bool border = row == 0 || col == 0 ||
+                                    row == GRID_ROWS - 1 ||
+                                    col == GRID_COLS - 1;
+                const int bit = (row - 1) * COLS + (col - 1);
+                if (border || (bits >> bit) & 1) {
+                    cv::rectangle(image,
+                                  cv::Rect(origin.x + col * cell,
+                                           origin.y + row * cell, cell, cell),
+                                  cv::Scalar::all(0), cv::FILLED);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Find and read a stamp in a camera frame. The working buffers are
+     * kept between calls, so use one `FrameStamp` per thread.
+     *
+     * @param   frame   A BGR frame
+     * @return          The identifier, or nothing if no stamp could be read
+     */
+    std::optional<std::uint32_t> decode(const cv::Mat &frame) {
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        // Dark cells become foreground. Every contour is listed, not only the
+        // outermost, as the stamp is usually inside the screen's dark bezel
+        cv::threshold(gray, binary, 0, 255,
+                      cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+        cv::findContours(binary, contours, cv::RETR_LIST,
+                         cv::CHAIN_APPROX_SIMPLE);
+        const double min_area = 0.01 * frame.cols * frame.rows;
+        for (const std::vector<cv::Point> &contour : contours) {
+            if (cv::contourArea(contour) < min_area) {
+                continue;
+            }
+            cv::approxPolyDP(contour, corners,
+                             0.03 * cv::arcLength(contour, true), true);
+            if (corners.size() != 4 || !cv::isContourConvex(corners)) {
+                continue;
+            }
+            if (const auto id = read(corners)) {
+                return id;
+            }
+        }
+        return std::nullopt;
+    }
+
+  private:
+    // Size of a cell once the stamp has been straightened, pixels
+    static constexpr int CELL = 12;
+
+    /**
+     * @brief The identifier in the low 24 bits and a check in the high 8.
+     */
+    static std::uint32_t encode(std::uint32_t id) {
+        id %= ID_LIMIT;
+        return id | static_cast<std::uint32_t>(check(id)) << 24;
+    }
+
+    static std::uint8_t check(std::uint32_t id) {
+        return ((id & 0xff) + (id >> 8 & 0xff) * 3 + (id >> 16 & 0xff) * 7) ^
+               0xa5;
+    }
+
+    /**
+     * @brief Straighten a candidate quadrilateral and read its cells.
+     */
+    std::optional<std::uint32_t> read(const std::vector<cv::Point> &quad) {
+        // Top left has the smallest x + y, top right the largest x - y
+        cv::Point2f ordered[4];
+        const auto sum = [](const cv::Point &p) { return p.x + p.y; };
+        const auto difference = [](const cv::Point &p) { return p.x - p.y; };
+        const auto by = [](auto key) {
+            return [key](const cv::Point &a, const cv::Point &b) {
+                return key(a) < key(b);
+            };
+        };
+        ordered[0] = *std::min_element(quad.begin(), quad.end(), by(sum));
+        ordered[1] =
+            *std::max_element(quad.begin(), quad.end(), by(difference));
+        ordered[2] = *std::max_element(quad.begin(), quad.end(), by(sum));
+        ordered[3] =
+            *std::min_element(quad.begin(), quad.end(), by(difference));
+        const float width = GRID_COLS * CELL;
+        const float height = GRID_ROWS * CELL;
+        const cv::Point2f target[4] = {
+            {0, 0}, {width, 0}, {width, height}, {0, height}};
+        const cv::Mat transform = cv::getPerspectiveTransform(ordered, target);
+        cv::warpPerspective(gray, straight, transform,
+                            cv::Size(GRID_COLS * CELL, GRID_ROWS * CELL));
+        cv::threshold(straight, straight, 0, 255,
+                      cv::THRESH_BINARY | cv::THRESH_OTSU);
+
+        std::uint32_t bits = 0;
+        for (int row = 0; row < GRID_ROWS; row++) {
+            for (int col = 0; col < GRID_COLS; col++) {
+                // Sample the middle of the cell, away from blurred edges
+                const cv::Rect centre(col * CELL + CELL / 3,
+                                      row * CELL + CELL / 3, CELL / 3,
+                                      CELL / 3);
+                const bool dark = cv::mean(straight(centre))[0] < 128;
+                const bool border = row == 0 || col == 0 ||
+                                    row == GRID_ROWS - 1 ||
+                                    col == GRID_COLS - 1;
+                if (border && !dark) {
+                    return std::nullopt;
+                }
+                if (!border && dark) {
+                    bits |= 1u << ((row - 1) * COLS + (col - 1));
+                }
+            }
+        }
+        const std::uint32_t id = bits & (ID_LIMIT - 1);
+        if (bits >> 24 != check(id)) {
+            return std::nullopt;
+        }
+        return id;
+    }
+
+    cv::Mat gray;
+    cv::Mat binary;
+    cv::Mat straight;
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<cv::Point> corners;
+};
+
+/**
+ * @brief Measures glass-to-command latency: the time from a frame appearing
+ * on screen to the command generated from the camera's view of it leaving
+ * the process.
+ *
+ * The probe is a window showing a stamped frame identifier and a moving
+ * target, for the drone's camera to film. The render loop notes when each
+ * identifier was shown, the track stage reads the identifier back from the
+ * camera frame, and the control stage takes a sample for every command it
+ * emits. The screen and the tracker share a clock, so no synchronisation is
+ * needed. Samples are accurate to about one screen refresh.
+ */
+class LatencyProbe {
+    using Clock = std::chrono::steady_clock;
+
+  public:
+    // Size of the probe window
+    static constexpr int WIDTH = 960;
+    static constexpr int HEIGHT = 720;
+    // Shortest time an identifier is shown for, about one 60Hz refresh
+    static constexpr std::chrono::milliseconds FRAME_PERIOD{16};
+    // Period of the target's sweep across the window, seconds
+    static constexpr double SWEEP_PERIOD = 4;
+
+    /**
+     * @brief One command, measured from its frame appearing on screen.
+     */
+    struct Sample {
+        std::uint32_t id;
+        // Screen to capture, and screen to command, microseconds
+        std::int64_t capture;
+        std::int64_t command;
+    };
+
+    LatencyProbe() : start(Clock::now()) { samples.reserve(MAX_SAMPLES); }
+
+    /**
+     * @brief Draw the next probe image, if the current one has been shown
+     * for long enough.
+     *
+     * @param   image   The probe image, redrawn in place
+     * @return          Whether the image changed and should be shown
+     */
+    bool render(cv::Mat &image) {
+        const auto now = Clock::now();
+        if (!image.empty() && now - drawn_at < FRAME_PERIOD) {
+            return false;
+        }
+        drawn_at = now;
+        image.create(HEIGHT, WIDTH, CV_8UC3);
+        image.setTo(cv::Scalar(200, 200, 200));
+        next_id = (next_id + 1) % FrameStamp::ID_LIMIT;
+        FrameStamp::draw(image, cv::Rect(40, 40, WIDTH - 80, 320), next_id);
+
+        // A target sweeping from side to side, so that commands are generated
+        const double seconds =
+            std::chrono::duration<double>(now - start).count();
+        const int x = static_cast<int>(
+            WIDTH / 2 +
+            (WIDTH / 2 - 120) * std::sin(2 * CV_PI * seconds / SWEEP_PERIOD));
+        const cv::Rect target(x - 60, 440, 120, 120);
+        cv::rectangle(image, target, cv::Scalar(0, 0, 255), cv::FILLED);
+        cv::rectangle(image, target, cv::Scalar(255, 255, 255), 8);
+        cv::circle(image, (target.tl() + target.br()) / 2, 20,
+                   cv::Scalar(255, 0, 0), cv::FILLED);
+        return true;
+    }
+
+    /**
+     * @brief Note that the last rendered image is now on screen.
+     */
+    void shown() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Shown &entry = history[next_id % history.size()];
+        entry.id = next_id;
+        entry.at = Clock::now();
+    }
+
+    /**
+     * @brief Take a sample for a command generated from a stamped frame.
+     *
+     * @param   id          The identifier read from the frame
+     * @param   captured    When the frame was read from the stream
+     * @param   emitted     When the command left the process
+     */
+    void commandEmitted(std::uint32_t id, Clock::time_point captured,
+                        Clock::time_point emitted) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const Shown &entry = history[id % history.size()];
+        // Too old, or a misread that passed the check
+        if (entry.id != id || entry.at > captured ||
+            samples.size() >= MAX_SAMPLES) {
+            return;
+        }
+        samples.push_back({id, micros(captured - entry.at),
+                           micros(emitted - entry.at)});
+    }
+
+    /**
+     * @brief Print the distribution of both latencies: count, mean,
+     * percentiles and a histogram of screen to command.
+     */
+    void print(std::ostream &out) const {
+        std::vector<Sample> sorted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sorted = samples;
+        }
+        out << "Glass to command latency, " << sorted.size() << " samples"
+            << std::endl;
+        if (sorted.empty()) {
+            return;
+        }
+        printDistribution(out, "screen to capture", sorted, &Sample::capture);
+        printDistribution(out, "screen to command", sorted, &Sample::command);
+
+        // 10ms buckets of screen to command
+        const std::int64_t bucket = 10000;
+        std::vector<size_t> counts;
+        for (const Sample &sample : sorted) {
+            const size_t index = std::max<std::int64_t>(0, sample.command) /
+                                 bucket;
+            counts.resize(std::max(counts.size(), index + 1));
+            counts[index]++;
+        }
+        for (size_t i = 0; i < counts.size(); i++) {
+            if (counts[i] == 0) {
+                continue;
+            }
+            out << "  " << i * 10 << "-" << (i + 1) * 10 << "ms "
+                << std::string(std::max<size_t>(
+                                   1, 50 * counts[i] / sorted.size()),
+                               '#')
+                << " " << counts[i] << std::endl;
+        }
+    }
+
+    /**
+     * @brief Write every sample, one `id,capture_us,command_us` line each.
+     */
+    void write(std::ostream &out) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "id,capture_us,command_us\n";
+        for (const Sample &sample : samples) {
+            out << sample.id << "," << sample.capture << "," << sample.command
+                << "\n";
+        }
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return samples.size();
+    }
+
+  private:
+    // Samples kept, about an hour of `rc` commands at 20Hz
+    static constexpr size_t MAX_SAMPLES = 1 << 16;
+
+    struct Shown {
+        std::uint32_t id = FrameStamp::ID_LIMIT;
+        Clock::time_point at;
+    };
+
+    static std::int64_t micros(Clock::duration duration) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+            .count();
+    }
+
+    static void printDistribution(std::ostream &out, const char *name,
+                                  std::vector<Sample> &sorted,
+                                  std::int64_t Sample::*field) {
+        std::sort(sorted.begin(), sorted.end(),
+                  [field](const Sample &a, const Sample &b) {
+                      return a.*field < b.*field;
+                  });
+        double total = 0;
+        for (const Sample &sample : sorted) {
+            total += sample.*field;
+        }
+        const auto at = [&](double quantile) {
+            const size_t index = std::min(
+                sorted.size() - 1,
+                static_cast<size_t>(quantile * sorted.size()));
+            return sorted[index].*field / 1000.0;
+        };
+        out << "  " << name << ": mean " << total / sorted.size() / 1000
+            << "ms min " << at(0) << "ms p50 " << at(0.5) << "ms p90 "
+            << at(0.9) << "ms p99 " << at(0.99) << "ms max " << at(1)
+            << "ms" << std::endl;
+    }
+
+    Clock::time_point start;
+    Clock::time_point drawn_at;
+    std::uint32_t next_id = 0;
+    // When each recent identifier was shown, about 4s at 60Hz
+    std::array<Shown, 256> history;
+    std::vector<Sample> samples;
+    mutable std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef LOGGING_HPP
+#define LOGGING_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <spdlog/async.h>
+#include <spdlog/sinks/ringbuffer_sink.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+/**
+ * @brief Logging for the live stages. A stage only formats its message into
+ * a queue, one background thread writes the queue to the console and keeps
+ * the newest messages in memory, so no stage waits on the terminal. If the
+ * queue fills the oldest messages are dropped rather than the stage blocking.
+ *
+ * Each session logs under its own name, and every message is an event name
+ * followed by `key=value` fields, e.g.
+ * `level=info session=out event=command command="left 20"`, so logs can be
+ * filtered and parsed.
+ */
+class Logging {
+  public:
+    // Messages waiting for the background thread
+    static constexpr size_t QUEUE_SIZE = 8192;
+    // Messages of every level kept in memory, written out by `dump`
+    static constexpr size_t RING_SIZE = 4096;
+
+    /**
+     * @param   console_level   The lowest level shown on the console, the
+     *                          memory keeps every level
+     */
+    explicit Logging(spdlog::level::level_enum console_level) {
+        spdlog::init_thread_pool(QUEUE_SIZE, 1);
+        auto console = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+        console->set_level(console_level);
+        ring = std::make_shared<spdlog::sinks::ringbuffer_sink_mt>(RING_SIZE);
+        ring->set_level(spdlog::level::trace);
+        sinks = {console, ring};
+    }
+
+    /**
+     * @brief A logger for one session, or the program as a whole.
+     */
+    std::shared_ptr<spdlog::logger> create(const std::string &name) const {
+        auto logger = std::make_shared<spdlog::async_logger>(
+            name, sinks.begin(), sinks.end(), spdlog::thread_pool(),
+            spdlog::async_overflow_policy::overrun_oldest);
+        logger->set_pattern(
+            "%Y-%m-%dT%H:%M:%S.%e %^level=%l%$ session=%n %v");
+        logger->set_level(spdlog::level::trace);
+        return logger;
+    }
+
+    /**
+     * @brief Write out every queued message, then stop the background thread.
+     * Loggers must not be used afterwards.
+     */
+    void shutdown() { spdlog::shutdown(); }
+
+    /**
+     * @brief Write the messages kept in memory, oldest first.
+     */
+    void dump(std::ostream &out) const {
+        for (const std::string &line : ring->last_formatted()) {
+            out << line;
+        }
+    }
+
+  private:
+    std::shared_ptr<spdlog::sinks::ringbuffer_sink_mt> ring;
+    std::vector<spdlog::sink_ptr> sinks;
+};
+
+/**
+ * @brief Limits a message that can happen on every frame to one per
+ * interval, counting the ones left out so the next can report them.
+ */
+class LogLimit {
+    using Clock = std::chrono::steady_clock;
+
+  public:
+    explicit LogLimit(std::chrono::milliseconds interval)
+        : interval(interval) {}
+
+    /**
+     * @brief Whether to log this occurrence.
+     *
+     * @param   suppressed  Set to the occurrences left out since the last
+     *                      one logged
+     */
+    bool allow(std::uint64_t &suppressed) {
+        const auto now = Clock::now();
+        if (logged && now - last < interval) {
+            skipped++;
+            return false;
+        }
+        logged = true;
+        last = now;
+        suppressed = skipped;
+        skipped = 0;
+        return true;
+    }
+
+  private:
+    const std::chrono::milliseconds interval;
+    Clock::time_point last;
+    bool logged = false;
+    std::uint64_t skipped = 0;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef METRICS_EXPORTER_HPP
+#define METRICS_EXPORTER_HPP
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+/**
+ * @brief Builds a Prometheus text format page in a fixed buffer, so a scrape
+ * never allocates and does not disturb the allocation counts of the live
+ * system. Anything past the end of the buffer is cut off.
+ */
+class MetricsText {
+  public:
+    /**
+     * @brief Start a metric family.
+     *
+     * @param   name    The metric name
+     * @param   type    `counter`, `gauge` or `summary`
+     * @param   help    One line description
+     */
+    void family(const char *name, const char *type, const char *help) {
+        append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    }
+
+    /**
+     * @brief Add a sample to the current family.
+     *
+     * @param   name        The metric name
+     * @param   value       The value
+     * @param   label       Label name, or `nullptr` for no label
+     * @param   label_value Label value
+     */
+    void sample(const char *name, double value, const char *label = nullptr,
+                const char *label_value = nullptr) {
+        if (label) {
+            append("%s{%s=\"%s\"} %.9g\n", name, label, label_value, value);
+        } else {
+            append("%s %.9g\n", name, value);
+        }
+    }
+
+    void clear() { length = 0; }
+    const char *data() const { return buffer.data(); }
+    size_t size() const { return length; }
+
+  private:
+    template <typename... Args> void append(const char *format, Args... args) {
+        const size_t space = buffer.size() - length;
+        const int written =
+            std::snprintf(buffer.data() + length, space, format, args...);
+        if (written > 0) {
+            length += std::min(static_cast<size_t>(written), space - 1);
+        }
+    }
+
+    std::array<char, 32768> buffer{};
+    size_t length = 0;
+};
+
+/**
+ * @brief Serves metrics over HTTP on the loopback interface, for Prometheus or
+ * a ground station dashboard to scrape at `http://127.0.0.1:PORT/metrics`.
+ *
+ * Scrapes are answered on the exporter's own thread, the collector should only
+ * read counters which the live stages already keep.
+ */
+class MetricsExporter {
+  public:
+    // Writes the current metrics, called once per scrape
+    using Collector = std::function<void(MetricsText &)>;
+
+    ~MetricsExporter() { stop(); }
+
+    /**
+     * @brief Bind the port and start answering scrapes.
+     *
+     * @param   port        The loopback port to listen on
+     * @param   collector   Writes the metrics
+     * @return              `false` if the port could not be bound
+     */
+    bool start(int port, Collector collector) {
+        server_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (server_fd < 0) {
+            return false;
+        }
+        const int reuse = 1;
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (bind(server_fd, reinterpret_cast<sockaddr *>(&address),
+                 sizeof(address)) < 0 ||
+            listen(server_fd, 4) < 0) {
+            close(server_fd);
+            server_fd = -1;
+            return false;
+        }
+        this->collector = std::move(collector);
+        running = true;
+        thread = std::thread(&MetricsExporter::run, this);
+        return true;
+    }
+
+    void stop() {
+        running = false;
+        if (thread.joinable()) {
+            thread.join();
+        }
+        if (server_fd >= 0) {
+            close(server_fd);
+            server_fd = -1;
+        }
+    }
+
+    // Number of scrapes answered
+    std::atomic<std::uint64_t> scrapes{0};
+
+  private:
+    void run() {
+        while (running) {
+            // Wake up regularly so `stop` is noticed without a scrape
+            pollfd waiting{server_fd, POLLIN, 0};
+            if (poll(&waiting, 1, 100) <= 0) {
+                continue;
+            }
+            const int client = accept(server_fd, nullptr, nullptr);
+            if (client < 0) {
+                continue;
+            }
+            respond(client);
+            close(client);
+        }
+    }
+
+    /**
+     * @brief Answer one request. Only the request line is looked at, every
+     * path other than `/metrics` is not found.
+     */
+    void respond(int client) {
+        // A slow or idle client must not hold up the next scrape
+        timeval timeout{1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[1024];
+        const ssize_t length = recv(client, request, sizeof(request) - 1, 0);
+        if (length <= 0) {
+            return;
+        }
+        request[length] = '\0';
+
+        char header[256];
+        if (std::strncmp(request, "GET /metrics", 12) != 0) {
+            const int size = std::snprintf(
+                header, sizeof(header),
+                "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+                "Connection: close\r\n\r\n");
+            sendAll(client, header, size);
+            return;
+        }
+        text.clear();
+        collector(text);
+        const int size = std::snprintf(
+            header, sizeof(header),
+            "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+            text.size());
+        sendAll(client, header, size);
+        sendAll(client, text.data(), text.size());
+        scrapes++;
+    }
+
+    static void sendAll(int client, const char *data, size_t length) {
+        while (length > 0) {
+            const ssize_t sent = send(client, data, length, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                return;
+            }
+            data += sent;
+            length -= sent;
+        }
+    }
+
+    int server_fd = -1;
+    Collector collector;
+    MetricsText text;
+    std::atomic<bool> running{false};
+    std::thread thread;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef PID_CONTROLLER_HPP
+#define PID_CONTROLLER_HPP
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/core.hpp>
+
+#include "drone-command.hpp"
+
+/**
+ * @brief A single axis PID loop. The output is clamped to +/- `LIMIT` and the
+ * integral term is only accumulated while the output is not saturated, so it
+ * cannot wind up while the drone is already moving at full speed.
+ *
+ * The gains are compile time constants, `Gains::KP`, `KI` and `KD`, so each
+ * loop is specialised and terms with a zero gain disappear.
+ */
+template <typename Gains, int LIMIT> struct PID {
+    float integral = 0;
+    float prev_error = 0;
+    bool primed = false;
+
+    /**
+     * @brief Advance the loop by one step.
+     *
+     * @param   error   The current error, setpoint minus measurement
+     * @param   dt      The time in seconds since the previous update
+     * @return          The clamped control output
+     */
+    float update(float error, float dt) {
+        // No derivative on the first sample, there is nothing to difference
+        const float derivative =
+            (primed && dt > 0) ? (error - prev_error) / dt : 0;
+        prev_error = error;
+        primed = true;
+
+        const float unclamped = Gains::KP * error +
+                                Gains::KI * (integral + error * dt) +
+                                Gains::KD * derivative;
+        const float limit = LIMIT;
+        const float output = std::clamp(unclamped, -limit, limit);
+        // Anti-windup, only integrate while the output is not saturated
+        if (output == unclamped) {
+            integral += error * dt;
+        }
+        return output;
+    }
+
+    /**
+     * @brief Clear the loop state, used when a new ROI is selected or tracking
+     * stops.
+     */
+    void reset() {
+        integral = 0;
+        prev_error = 0;
+        primed = false;
+    }
+};
+
+/**
+ * @brief The gains of the `rc` controller's loops, and the largest speed it
+ * will command on any axis. Pass a struct of the same shape to
+ * `BasicRCController` to build a differently tuned controller.
+ */
+struct RCGains {
+    static constexpr int LIMIT = 60;
+    struct Lateral {
+        static constexpr float KP = 40, KI = 5, KD = 8;
+    };
+    struct Forward {
+        static constexpr float KP = 80, KI = 5, KD = 10;
+    };
+    struct Vertical {
+        static constexpr float KP = 50, KI = 5, KD = 8;
+    };
+    struct Yaw {
+        static constexpr float KP = 20, KI = 0, KD = 4;
+    };
+};
+
+/**
+ * @brief Continuous controller which runs all four axes through their own PID
+ * loops every update, as opposed to `Steer` which picks a single axis.
+ *
+ * Errors are normalised before they reach the loops: the planar errors by half
+ * the frame size, so they lie in [-1, 1], and the longitudinal error as
+ * 1 - (current ROI size / initial ROI size). The lateral and yaw loops share
+ * the horizontal error, their gains decide how much of the correction is a
+ * strafe and how much is a turn.
+ */
+template <typename Gains = RCGains> class BasicRCController {
+  public:
+    // Largest speed the controller will command on any axis
+    static constexpr int RC_LIMIT = Gains::LIMIT;
+
+    /**
+     * @brief Compute the velocity setpoints for the current ROI.
+     *
+     * @param   origin          The position of the drone in the frame
+     * @param   roi             The ROI around the object being tracked
+     * @param   original_size   The size of the ROI when it was initialised
+     * @param   dt              The time in seconds since the previous update
+     * @param   roi_scale       The longitudinal dead band, 1 +/- `roi_scale`
+     * @return                  The setpoints to send to the drone
+     */
+    RCSetpoint update(const cv::Point2i &origin, const cv::Rect &roi,
+                      const cv::Size &original_size, float dt,
+                      float roi_scale) {
+        const cv::Point2i target = (roi.br() + roi.tl()) / 2;
+        const float error_x =
+            static_cast<float>(target.x - origin.x) / origin.x;
+        // Image y grows downwards, rc c is positive upwards
+        const float error_y =
+            static_cast<float>(origin.y - target.y) / origin.y;
+        const float ratio =
+            ((static_cast<float>(roi.width) / original_size.width) +
+             (static_cast<float>(roi.height) / original_size.height)) /
+            2;
+        float error_z = 1 - ratio;
+        // Hold the distance while the size is within the acceptable range,
+        // the size estimate from the tracker is too noisy to chase exactly
+        if (std::abs(error_z) < roi_scale) {
+            error_z = 0;
+        }
+
+        RCSetpoint setpoint;
+        setpoint.lateral =
+            static_cast<int>(std::lround(lateral.update(error_x, dt)));
+        setpoint.forward =
+            static_cast<int>(std::lround(forward.update(error_z, dt)));
+        setpoint.vertical =
+            static_cast<int>(std::lround(vertical.update(error_y, dt)));
+        setpoint.yaw = static_cast<int>(std::lround(yaw.update(error_x, dt)));
+        return setpoint;
+    }
+
+    void reset() {
+        lateral.reset();
+        forward.reset();
+        vertical.reset();
+        yaw.reset();
+    }
+
+  private:
+    PID<typename Gains::Lateral, RC_LIMIT> lateral;
+    PID<typename Gains::Forward, RC_LIMIT> forward;
+    PID<typename Gains::Vertical, RC_LIMIT> vertical;
+    PID<typename Gains::Yaw, RC_LIMIT> yaw;
+};
+
+using RCController = BasicRCController<>;
+
+#endif
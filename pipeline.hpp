@@ -0,0 +1,147 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <opencv2/core.hpp>
+
+#include "frame-pool.hpp"
+#include "spsc-queue.hpp"
+#include "tracking-core.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Everything known about one frame as it moves through the pipeline.
+ *
+ * Ownership moves with the packet: a stage may only touch a packet between
+ * popping it from its input queue and pushing it to its output queue. `frame`
+ * is the exception, it is shared with the clean recorder and so is never
+ * written to after ingest, overlays are drawn on `image` instead.
+ *
+ * `frame` and `image` normally point into `FramePool` buffers, held by the
+ * leases below, which go back to the pool when the last packet referring to
+ * them is destroyed.
+ */
+struct FramePacket {
+    // Sequence number assigned at capture
+    std::uint64_t id = 0;
+    // Time the frame was read from the stream
+    Clock::time_point captured;
+    // The decoded frame, read only after ingest
+    cv::Mat frame;
+    // Copy of the frame that the render stage draws overlays on
+    cv::Mat image;
+    FramePool::Lease frame_buffer;
+    FramePool::Lease image_buffer;
+
+    // Set by the track stage
+    // The ROI around the object, empty when nothing is being tracked
+    cv::Rect roi;
+    // The size of the ROI when the tracker was initialised
+    cv::Size roi_size;
+    // The tracker was (re)initialised on this frame
+    bool new_target = false;
+    // The tracker's update succeeded, and its confidence, negative if the
+    // backend does not report one
+    bool tracked = false;
+    float confidence = -1;
+    // The frame identifier read by the latency probe, negative if none
+    std::int64_t stamp = -1;
+    // Shift of the whole image since the previous frame caused by the drone
+    // moving, and the target's movement with that shift taken out, zero when
+    // ego-motion is off or could not be estimated
+    cv::Point2f ego_shift;
+    cv::Point2f target_motion;
+
+    // Set by the control stage
+    // The command generated for this frame, empty if none
+    DroneCommand command;
+    // Whether commands were allowed, from the tracker's confidence
+    TrackState state = TrackState::Tracking;
+    // The planar movement from `Steer` or the rc controller
+    cv::Point2i velocity;
+    // The command came from `Steer`, rather than `LongitudinalMove`
+    bool planar = false;
+};
+
+/**
+ * @brief Throughput and latency counters for one stage, written by the stage
+ * thread and read by anyone.
+ */
+struct StageStats {
+    std::atomic<std::uint64_t> processed{0};
+    std::atomic<std::uint64_t> dropped{0};
+    // Sum and maximum of capture to stage completion time, microseconds
+    std::atomic<std::int64_t> total_latency{0};
+    std::atomic<std::int64_t> max_latency{0};
+
+    /**
+     * @brief Record that a packet has finished this stage.
+     *
+     * @param   captured    The time the packet's frame was captured
+     */
+    void record(Clock::time_point captured) {
+        const std::int64_t latency =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - captured)
+                .count();
+        processed++;
+        total_latency += latency;
+        if (latency > max_latency.load(std::memory_order_relaxed)) {
+            max_latency.store(latency, std::memory_order_relaxed);
+        }
+    }
+
+    double meanLatencyMs() const {
+        const std::uint64_t n = processed.load();
+        return n > 0 ? total_latency.load() / 1000.0 / n : 0;
+    }
+};
+
+/**
+ * @brief Push a packet downstream, or count it as dropped if the next stage
+ * has fallen behind. Live stages never block on a slower neighbour.
+ *
+ * @return  `true` if the packet was queued
+ */
+template <typename Queue>
+bool pushOrDrop(Queue &queue, FramePacket &packet, StageStats &stats) {
+    if (queue.tryPush(packet)) {
+        return true;
+    }
+    stats.dropped++;
+    return false;
+}
+
+/**
+ * @brief Back off while a stage has nothing to do. Short enough to add
+ * negligible latency at 30fps, long enough not to burn a core spinning.
+ */
+inline void idle() {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+/**
+ * @brief Print one line of stage statistics.
+ *
+ * @param   name        The stage name
+ * @param   stats       The stage counters
+ * @param   depth       The current depth of the stage's input queue
+ * @param   max_depth   The largest depth of the stage's input queue
+ */
+inline void printStage(const std::string &name, const StageStats &stats,
+                       size_t depth, size_t max_depth) {
+    std::cout << name << ": processed " << stats.processed << ", dropped "
+              << stats.dropped << ", latency mean " << stats.meanLatencyMs()
+              << "ms max " << stats.max_latency / 1000.0 << "ms, queue "
+              << depth << " (max " << max_depth << ")" << std::endl;
+}
+
+#endif
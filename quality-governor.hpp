@@ -0,0 +1,138 @@
+#ifndef QUALITY_GOVERNOR_HPP
+#define QUALITY_GOVERNOR_HPP
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief What the pipeline does at one quality level.
+ */
+struct QualityLevel {
+    const char *name;
+    // The tracker runs on the frame scaled by this
+    double track_scale;
+    // The tracker is updated on one frame in this many, the ROI is carried
+    // over on the others
+    int track_every;
+    // The overlay video is recorded, when `eval` asked for it
+    bool record_dirty;
+    // One frame in this many is drawn and shown
+    int display_every;
+    // The correlation filter tracker replaces the chosen one
+    bool fast_tracker;
+};
+
+// From full quality down, each level cheaper than the last
+constexpr QualityLevel QUALITY_LEVELS[] = {
+    {"full", 1.0, 1, true, 1, false},
+    {"scaled", 0.75, 1, true, 1, false},
+    {"no_overlay_video", 0.75, 1, false, 2, false},
+    {"half", 0.5, 1, false, 2, false},
+    {"skip", 0.5, 2, false, 3, false},
+    {"fast_tracker", 0.5, 1, false, 3, true},
+};
+constexpr int QUALITY_COUNT =
+    sizeof(QUALITY_LEVELS) / sizeof(QUALITY_LEVELS[0]);
+
+/**
+ * @brief Moves the quality level to keep frames within a deadline. Frames
+ * are judged in windows of a second: a window where more than one frame in
+ * ten missed the deadline, or was dropped before it could be tracked, drops
+ * a level straight away, while a level is only regained after several
+ * windows with no misses and time to spare. The window after a change is not
+ * judged, so the cost of the change itself, such as restarting the tracker,
+ * does not count against the new level.
+ */
+class QualityGovernor {
+  public:
+    // Frames in a window, a second at 30fps
+    static constexpr int WINDOW = 30;
+    // Share of missed frames in a window that drops a level
+    static constexpr double DEGRADE_ABOVE = 0.1;
+    // Mean frame time, as a share of the deadline, below which a window
+    // counts towards regaining a level, and the windows in a row needed
+    static constexpr double RECOVER_BELOW = 0.6;
+    static constexpr int RECOVER_WINDOWS = 5;
+
+    /**
+     * @param   deadline    Time allowed from capture to the end of tracking
+     */
+    explicit QualityGovernor(std::chrono::microseconds deadline)
+        : deadline(deadline) {}
+
+    /**
+     * @brief Judge one frame.
+     *
+     * @param   elapsed From capture to the end of tracking
+     * @param   dropped Frames dropped in front of the tracker since the last
+     *                  call, each counts as a miss
+     * @return          Whether the level changed
+     */
+    bool update(std::chrono::microseconds elapsed, std::uint64_t dropped) {
+        frames += 1 + static_cast<int>(dropped);
+        missed += static_cast<int>(dropped) + (elapsed > deadline);
+        timed++;
+        total += elapsed;
+        if (frames < WINDOW) {
+            return false;
+        }
+        last_miss_ratio = static_cast<double>(missed) / frames;
+        last_mean = total / timed;
+        const bool judged = !settling;
+        settling = false;
+        frames = 0;
+        missed = 0;
+        timed = 0;
+        total = std::chrono::microseconds(0);
+        if (!judged) {
+            return false;
+        }
+
+        if (last_miss_ratio > DEGRADE_ABOVE) {
+            good_windows = 0;
+            return change(current + 1);
+        }
+        if (last_miss_ratio == 0 && last_mean < deadline * RECOVER_BELOW) {
+            if (++good_windows >= RECOVER_WINDOWS) {
+                good_windows = 0;
+                return change(current - 1);
+            }
+        } else {
+            good_windows = 0;
+        }
+        return false;
+    }
+
+    int level() const { return current; }
+    const QualityLevel &settings() const { return QUALITY_LEVELS[current]; }
+
+    // The last window judged, for logging changes
+    double missRatio() const { return last_miss_ratio; }
+    double meanMs() const { return last_mean.count() / 1000.0; }
+
+  private:
+    bool change(int level) {
+        if (level < 0 || level >= QUALITY_COUNT) {
+            return false;
+        }
+        current = level;
+        settling = true;
+        return true;
+    }
+
+    const std::chrono::microseconds deadline;
+    int current = 0;
+    // The window being counted, every frame, those which missed and the
+    // total time of those which were tracked
+    int frames = 0;
+    int missed = 0;
+    int timed = 0;
+    std::chrono::microseconds total{0};
+    // Windows in a row good enough to regain a level
+    int good_windows = 0;
+    bool settling = false;
+    double last_miss_ratio = 0;
+    std::chrono::microseconds last_mean{0};
+};
+
+#endif
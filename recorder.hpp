@@ -0,0 +1,460 @@
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+/**
+ * @brief The encoders a recording can be saved with.
+ *
+ * `MJPG`   Motion JPEG, cheap to encode, lossy, large files
+ * `FFV1`   Lossless, for recordings used as tracker evaluation data
+ * `Raw`    Uncompressed BGR, no encode cost at all but ~2MB per frame
+ * `Log`    Uncompressed BGR in a `FrameLogHeader` file, which can be
+ *          memory mapped and played back without decoding or copying
+ * `H264`   The drone's own H.264 bitstream saved as it arrives, never decoded
+ *          or re-encoded. Only possible for the clean video
+ */
+enum class Codec { MJPG, FFV1, Raw, Log, H264 };
+
+/**
+ * @brief Parse a codec name as given on the command line.
+ *
+ * @param   name    `mjpg`, `ffv1`, `raw`, `log` or `h264`
+ * @param   codec   Set to the codec if the name is known
+ * @return          `false` if the name is not a codec
+ */
+inline bool parseCodec(const std::string &name, Codec &codec) {
+    if (name == "mjpg") {
+        codec = Codec::MJPG;
+    } else if (name == "ffv1") {
+        codec = Codec::FFV1;
+    } else if (name == "raw") {
+        codec = Codec::Raw;
+    } else if (name == "log") {
+        codec = Codec::Log;
+    } else if (name == "h264") {
+        codec = Codec::H264;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline const char *codecName(Codec codec) {
+    switch (codec) {
+    case Codec::MJPG:
+        return "mjpg";
+    case Codec::FFV1:
+        return "ffv1";
+    case Codec::Raw:
+        return "raw";
+    case Codec::Log:
+        return "log";
+    case Codec::H264:
+        return "h264";
+    }
+    return "";
+}
+
+/**
+ * @brief The file extension for a codec, H.264 is saved as an Annex B
+ * elementary stream which ffplay and VLC play directly.
+ */
+inline const char *codecExtension(Codec codec) {
+    switch (codec) {
+    case Codec::FFV1:
+        return ".mkv";
+    case Codec::Log:
+        return ".frames";
+    case Codec::H264:
+        return ".h264";
+    default:
+        return ".avi";
+    }
+}
+
+/**
+ * @brief The `cv::VideoWriter` fourcc for a codec. Zero selects uncompressed
+ * video with the FFmpeg backend.
+ */
+inline int codecFourcc(Codec codec) {
+    switch (codec) {
+    case Codec::FFV1:
+        return cv::VideoWriter::fourcc('F', 'F', 'V', '1');
+    case Codec::Raw:
+        return 0;
+    default:
+        return cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+    }
+}
+
+/**
+ * @brief The start of a frame log. Frames follow back to back, each
+ * `height * width * CV_ELEM_SIZE(type)` bytes of continuous pixels.
+ */
+struct FrameLogHeader {
+    char magic[8] = {'F', 'R', 'A', 'M', 'E', 'L', 'O', 'G'};
+    std::int32_t width = 0;
+    std::int32_t height = 0;
+    std::int32_t type = 0;
+    std::int32_t reserved = 0;
+    double fps = 30;
+
+    bool valid() const {
+        return std::equal(magic, magic + sizeof(magic), "FRAMELOG") &&
+               width > 0 && height > 0;
+    }
+};
+
+/**
+ * @brief When to close a file and start the next segment. A limit of zero is
+ * no limit, and with no limits a recording is one file.
+ */
+struct SegmentPolicy {
+    // Length of video in a segment
+    double max_seconds = 0;
+    // Size of a segment on disk
+    std::uintmax_t max_bytes = 0;
+
+    bool enabled() const { return max_seconds > 0 || max_bytes > 0; }
+
+    bool due(double seconds, std::uintmax_t bytes) const {
+        return (max_seconds > 0 && seconds >= max_seconds) ||
+               (max_bytes > 0 && bytes >= max_bytes);
+    }
+};
+
+/**
+ * @brief The path of one segment of a recording. An unsegmented recording
+ * keeps the plain `BASE.ext` name, segments are `BASE_000.ext`, `BASE_001.ext`
+ * and so on.
+ *
+ * @param   base    The path without extension
+ * @param   codec   The codec, gives the extension
+ * @param   policy  The segment policy
+ * @param   index   The segment number
+ */
+inline std::string segmentPath(const std::string &base, Codec codec,
+                               const SegmentPolicy &policy, size_t index) {
+    if (!policy.enabled()) {
+        return base + codecExtension(codec);
+    }
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "_%03zu", index);
+    return base + suffix + codecExtension(codec);
+}
+
+/**
+ * @brief Encodes decoded frames to a recording, split into segments. Used for
+ * every codec except `H264`.
+ */
+class SegmentedWriter {
+  public:
+    /**
+     * @brief Open the first segment.
+     *
+     * @param   base    The path without extension
+     * @param   codec   The codec, not `H264`
+     * @param   fps     The frame rate of the video
+     * @param   size    The frame size
+     * @param   policy  When to start a new segment
+     * @return          `false` if the file could not be opened
+     */
+    bool open(const std::string &base, Codec codec, double fps, cv::Size size,
+              SegmentPolicy policy = SegmentPolicy()) {
+        this->base = base;
+        this->codec = codec;
+        this->fps = fps > 0 ? fps : 30;
+        this->size = size;
+        this->policy = policy;
+        index = 0;
+        return openSegment();
+    }
+
+    /**
+     * @brief Encode a frame, first starting a new segment if the current one
+     * is full.
+     */
+    void write(const cv::Mat &frame) {
+        if (!isOpened()) {
+            return;
+        }
+        // File size is only checked once a second of video, it is a syscall
+        if (policy.max_bytes > 0 &&
+            frames % std::max(1, static_cast<int>(fps)) == 0) {
+            std::error_code error;
+            const std::uintmax_t bytes =
+                std::filesystem::file_size(segmentPath(base, codec, policy,
+                                                       index),
+                                           error);
+            segment_bytes = error ? 0 : bytes;
+        }
+        if (policy.due(frames / fps, segment_bytes)) {
+            index++;
+            openSegment();
+        }
+        if (codec == Codec::Log) {
+            for (int y = 0; y < frame.rows; y++) {
+                log.write(frame.ptr<char>(y), frame.cols * frame.elemSize());
+            }
+        } else {
+            writer.write(frame);
+        }
+        frames++;
+    }
+
+    /**
+     * @brief Flush and close the current segment.
+     */
+    void release() {
+        writer.release();
+        log.close();
+    }
+
+    bool isOpened() const {
+        return codec == Codec::Log ? log.is_open() : writer.isOpened();
+    }
+
+    // Number of segments written so far
+    size_t segments() const { return index + 1; }
+
+  private:
+    bool openSegment() {
+        release();
+        frames = 0;
+        segment_bytes = 0;
+        if (codec == Codec::Log) {
+            FrameLogHeader header;
+            header.width = size.width;
+            header.height = size.height;
+            header.type = CV_8UC3;
+            header.fps = fps;
+            log.open(segmentPath(base, codec, policy, index),
+                     std::ios::binary | std::ios::trunc);
+            log.write(reinterpret_cast<const char *>(&header),
+                      sizeof(header));
+            return log.good();
+        }
+        return writer.open(segmentPath(base, codec, policy, index),
+                           cv::CAP_FFMPEG, codecFourcc(codec), fps, size);
+    }
+
+    cv::VideoWriter writer;
+    std::ofstream log;
+    std::string base;
+    Codec codec = Codec::MJPG;
+    double fps = 30;
+    cv::Size size;
+    SegmentPolicy policy;
+    size_t index = 0;
+    // Frames and bytes in the current segment
+    int frames = 0;
+    std::uintmax_t segment_bytes = 0;
+};
+
+/**
+ * @brief Saves an H.264 Annex B bitstream as it arrives, split into segments.
+ * A new segment only starts on a sequence parameter set, which the Tello sends
+ * before every keyframe, so that each file can be decoded on its own.
+ */
+class H264SegmentWriter {
+  public:
+    /**
+     * @param   base    The path without extension
+     * @param   policy  When to start a new segment
+     */
+    bool open(const std::string &base, SegmentPolicy policy = SegmentPolicy()) {
+        this->base = base;
+        this->policy = policy;
+        index = 0;
+        started = false;
+        return true;
+    }
+
+    /**
+     * @brief Append a chunk of the bitstream, e.g. one UDP datagram. Anything
+     * before the first sequence parameter set is dropped, it cannot be
+     * decoded.
+     */
+    void write(const char *data, size_t length) {
+        const bool keyframe = startsSequence(data, length);
+        if (keyframe) {
+            const double seconds =
+                std::chrono::duration<double>(Clock::now() - segment_start)
+                    .count();
+            if (!started) {
+                started = openSegment();
+            } else if (policy.due(seconds, segment_bytes)) {
+                index++;
+                openSegment();
+            }
+        }
+        if (!started) {
+            return;
+        }
+        file.write(data, length);
+        segment_bytes += length;
+    }
+
+    void release() { file.close(); }
+
+    // Number of segments written so far
+    size_t segments() const { return started ? index + 1 : 0; }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Whether a chunk starts with a sequence parameter set NAL unit,
+     * `00 00 00 01` then NAL type 7.
+     */
+    static bool startsSequence(const char *data, size_t length) {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+        return length > 4 && bytes[0] == 0 && bytes[1] == 0 && bytes[2] == 0 &&
+               bytes[3] == 1 && (bytes[4] & 0x1f) == 7;
+    }
+
+    bool openSegment() {
+        file.close();
+        file.open(segmentPath(base, Codec::H264, policy, index),
+                  std::ios::binary | std::ios::trunc);
+        segment_start = Clock::now();
+        segment_bytes = 0;
+        return file.is_open();
+    }
+
+    std::ofstream file;
+    std::string base;
+    SegmentPolicy policy;
+    size_t index = 0;
+    bool started = false;
+    Clock::time_point segment_start;
+    std::uintmax_t segment_bytes = 0;
+};
+
+/**
+ * @brief Sits between the drone and the decoder to record the H.264 stream
+ * without re-encoding it. Each datagram from the drone is forwarded unchanged
+ * to a loopback port, which the `cv::VideoCapture` opens instead of the
+ * drone's port, and then appended to the recording.
+ */
+class H264Relay {
+  public:
+    ~H264Relay() { stop(); }
+
+    /**
+     * @brief Bind the drone's video port and start relaying.
+     *
+     * @param   listen_port     The port the drone streams to, 11111
+     * @param   forward_port    The loopback port to forward to
+     * @param   base            The recording path without extension
+     * @param   policy          When to start a new segment
+     * @return                  `false` if the port could not be bound
+     */
+    bool start(int listen_port, int forward_port, const std::string &base,
+               SegmentPolicy policy = SegmentPolicy()) {
+        socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (socket_fd < 0) {
+            return false;
+        }
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(listen_port);
+        // Wake up regularly so `stop` is noticed while the stream is quiet
+        timeval timeout{0, 100000};
+        setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                   sizeof(timeout));
+        if (bind(socket_fd, reinterpret_cast<sockaddr *>(&local),
+                 sizeof(local)) < 0) {
+            close(socket_fd);
+            socket_fd = -1;
+            return false;
+        }
+        forward = sockaddr_in{};
+        forward.sin_family = AF_INET;
+        forward.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        forward.sin_port = htons(forward_port);
+        this->forward_port = forward_port;
+
+        recording.open(base, policy);
+        running = true;
+        thread = std::thread(&H264Relay::run, this);
+        return true;
+    }
+
+    /**
+     * @brief Stop relaying and close the recording.
+     */
+    void stop() {
+        running = false;
+        if (thread.joinable()) {
+            thread.join();
+        }
+        if (socket_fd >= 0) {
+            close(socket_fd);
+            socket_fd = -1;
+        }
+        recording.release();
+    }
+
+    /**
+     * @brief The URL for `cv::VideoCapture` to read the relayed stream from.
+     */
+    std::string url() const {
+        return "udp://0.0.0.0:" + std::to_string(forward_port);
+    }
+
+    size_t segments() const { return recording.segments(); }
+
+    // Datagrams and bytes relayed
+    std::atomic<std::uint64_t> packets{0};
+    std::atomic<std::uint64_t> bytes{0};
+
+  private:
+    void run() {
+        // Larger than any UDP datagram the drone sends
+        char buffer[65536];
+        while (running) {
+            const ssize_t length = recv(socket_fd, buffer, sizeof(buffer), 0);
+            if (length <= 0) {
+                continue;
+            }
+            // Forward first, the decoder is on the critical path and the
+            // recording is not
+            sendto(socket_fd, buffer, length, 0,
+                   reinterpret_cast<const sockaddr *>(&forward),
+                   sizeof(forward));
+            recording.write(buffer, length);
+            packets++;
+            bytes += length;
+        }
+    }
+
+    int socket_fd = -1;
+    int forward_port = 0;
+    sockaddr_in forward{};
+    H264SegmentWriter recording;
+    std::atomic<bool> running{false};
+    std::thread thread;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "recorder.hpp"
+
+// Frame budget at the Tello's 30fps
+const double FRAME_BUDGET_MS = 1000.0 / 30;
+// Size of the drone's video datagrams, used to feed the H.264 writer
+const size_t DATAGRAM_SIZE = 1460;
+
+/**
+ * @brief Total size of every file in a directory whose name starts with a
+ * prefix, i.e. every segment of one recording.
+ */
+std::uintmax_t recordingSize(const std::string &directory,
+                             const std::string &prefix) {
+    std::uintmax_t total = 0;
+    for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.path().filename().string().rfind(prefix, 0) == 0) {
+            total += entry.file_size();
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief Print one line of results.
+ *
+ * @param   codec       The codec name
+ * @param   frames      Number of frames written
+ * @param   times       Time taken to write each frame, milliseconds
+ * @param   finalise    Time taken to close the recording, milliseconds
+ * @param   bytes       Size of the recording on disk
+ * @param   segments    Number of segments written
+ */
+void printResult(const std::string &codec, size_t frames,
+                 std::vector<double> times, double finalise,
+                 std::uintmax_t bytes, size_t segments) {
+    if (times.empty()) {
+        return;
+    }
+    double total = 0;
+    for (double time : times) {
+        total += time;
+    }
+    std::sort(times.begin(), times.end());
+    const double mean = total / times.size();
+    std::cout << codec << " frames " << frames << " mean " << mean
+              << "ms p99 " << times[times.size() * 99 / 100] << "ms max "
+              << times.back() << "ms finalise " << finalise << "ms size "
+              << bytes / 1e6 << "MB (" << bytes / frames / 1e3
+              << "KB/frame) segments " << segments << " budget used "
+              << 100 * mean / FRAME_BUDGET_MS << "%" << std::endl;
+}
+
+/**
+ * @brief Time how long it takes to encode every frame with a codec.
+ *
+ * @param   frames      The decoded frames
+ * @param   codec       The codec, not `H264`
+ * @param   fps         The frame rate
+ * @param   directory   Where to write the recording
+ * @param   policy      When to start a new segment
+ */
+void benchEncode(const std::vector<cv::Mat> &frames, Codec codec, double fps,
+                 const std::string &directory, const SegmentPolicy &policy) {
+    const std::string prefix = std::string("bench-") + codecName(codec);
+    SegmentedWriter writer;
+    if (!writer.open(directory + "/" + prefix, codec, fps, frames[0].size(),
+                     policy)) {
+        std::cout << codecName(codec) << " not supported by this OpenCV build"
+                  << std::endl;
+        return;
+    }
+    std::vector<double> times;
+    times.reserve(frames.size());
+    for (const cv::Mat &frame : frames) {
+        const auto start = std::chrono::steady_clock::now();
+        writer.write(frame);
+        times.push_back(std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+    }
+    const auto start = std::chrono::steady_clock::now();
+    writer.release();
+    const double finalise = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    printResult(codecName(codec), frames.size(), times, finalise,
+                recordingSize(directory, prefix), writer.segments());
+}
+
+/**
+ * @brief Time how long it takes to record an H.264 bitstream without
+ * re-encoding it, fed in datagram sized chunks as the relay would.
+ *
+ * @param   path        An H.264 elementary stream
+ * @param   frames      The number of frames in the stream
+ * @param   directory   Where to write the recording
+ * @param   policy      When to start a new segment
+ */
+void benchPassthrough(const std::string &path, size_t frames,
+                      const std::string &directory,
+                      const SegmentPolicy &policy) {
+    std::ifstream in(path, std::ios::binary);
+    const std::vector<char> stream((std::istreambuf_iterator<char>(in)),
+                                   std::istreambuf_iterator<char>());
+    const std::string prefix = "bench-h264";
+    H264SegmentWriter writer;
+    writer.open(directory + "/" + prefix, policy);
+    // Time per datagram, spread over the frames for the per-frame figure
+    std::vector<double> times;
+    times.reserve(stream.size() / DATAGRAM_SIZE + 1);
+    for (size_t offset = 0; offset < stream.size(); offset += DATAGRAM_SIZE) {
+        const size_t length = std::min(DATAGRAM_SIZE, stream.size() - offset);
+        const auto start = std::chrono::steady_clock::now();
+        writer.write(stream.data() + offset, length);
+        times.push_back(std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+    }
+    const auto start = std::chrono::steady_clock::now();
+    writer.release();
+    const double finalise = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    double total = 0;
+    for (double time : times) {
+        total += time;
+    }
+    // One "frame" per frame's worth of datagrams
+    std::vector<double> per_frame(frames, total / frames);
+    printResult("h264", frames, per_frame, finalise,
+                recordingSize(directory, prefix), writer.segments());
+}
+
+int main(int argc, char *argv[]) {
+    std::string clip;
+    std::string output = "bench-output";
+    size_t max_frames = 300;
+    SegmentPolicy policy;
+
+    // Check command line arguments and set variables based on these
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            max_frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--segment-seconds" && i + 1 < argc) {
+            policy.max_seconds = std::atof(argv[++i]);
+        } else if (arg == "--segment-mb" && i + 1 < argc) {
+            policy.max_bytes =
+                static_cast<std::uintmax_t>(std::atof(argv[++i]) * 1e6);
+        } else if (clip.empty() && arg.rfind("--", 0) != 0) {
+            clip = arg;
+        } else {
+            clip.clear();
+            break;
+        }
+    }
+    if (clip.empty()) {
+        std::cout << "Incorrect usage, please use: ";
+        std::cout << "./recording-bench CLIP [--frames N] [--output DIR] "
+                     "[--segment-seconds N] [--segment-mb N]"
+                  << std::endl;
+        return 0;
+    }
+
+    // Decode up front so only the encoder is timed
+    cv::VideoCapture cap(clip);
+    if (!cap.isOpened()) {
+        std::cout << "Cannot open " << clip << std::endl;
+        return 0;
+    }
+    const double fps = cap.get(cv::CAP_PROP_FPS) > 0
+                           ? cap.get(cv::CAP_PROP_FPS)
+                           : 30;
+    std::vector<cv::Mat> frames;
+    cv::Mat frame;
+    while (frames.size() < max_frames && cap.read(frame)) {
+        frames.push_back(frame.clone());
+    }
+    if (frames.empty()) {
+        std::cout << "No frames in " << clip << std::endl;
+        return 0;
+    }
+    std::cout << "Encoding " << frames.size() << " frames of "
+              << frames[0].cols << "x" << frames[0].rows << " at " << fps
+              << "fps" << std::endl;
+
+    std::filesystem::create_directories(output);
+    for (Codec codec : {Codec::MJPG, Codec::FFV1, Codec::Raw, Codec::Log}) {
+        benchEncode(frames, codec, fps, output, policy);
+    }
+    // Passthrough needs the bitstream itself, e.g. a recording made with
+    // `--codec h264`
+    const std::string extension = std::filesystem::path(clip).extension();
+    if (extension == ".h264" || extension == ".264") {
+        // Every frame of the stream is written, count them all
+        cv::VideoCapture count(clip);
+        size_t total_frames = 0;
+        while (count.grab()) {
+            total_frames++;
+        }
+        benchPassthrough(clip, std::max<size_t>(1, total_frames), output,
+                         policy);
+    } else {
+        std::cout << "h264 skipped, passthrough needs an H.264 elementary "
+                     "stream (.h264) as the clip"
+                  << std::endl;
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/**
+ * @brief Bounded lock-free queue for exactly one producer thread and one
+ * consumer thread. Elements are moved in and out of a fixed ring, so a queue
+ * never allocates after construction.
+ *
+ * @tparam  T           The element type, must be default constructible
+ * @tparam  Capacity    The number of slots, a power of two
+ */
+template <typename T, size_t Capacity> class SPSCQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SPSCQueue capacity must be a power of two");
+
+  public:
+    /**
+     * @brief Producer only. Move an element into the queue.
+     *
+     * @param   value   The element, left moved-from on success
+     * @return          `false` if the queue is full, `value` is untouched
+     */
+    bool tryPush(T &value) {
+        const size_t tail = write_index.load(std::memory_order_relaxed);
+        const size_t head = read_index.load(std::memory_order_acquire);
+        if (tail - head == Capacity) {
+            return false;
+        }
+        slots[tail & (Capacity - 1)] = std::move(value);
+        write_index.store(tail + 1, std::memory_order_release);
+
+        // Depth high watermark, only the producer writes it
+        const size_t depth = tail + 1 - head;
+        if (depth > max_depth.load(std::memory_order_relaxed)) {
+            max_depth.store(depth, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Consumer only. Move the oldest element out of the queue.
+     *
+     * @param   value   Set to the element
+     * @return          `false` if the queue is empty
+     */
+    bool tryPop(T &value) {
+        const size_t head = read_index.load(std::memory_order_relaxed);
+        const size_t tail = write_index.load(std::memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+        value = std::move(slots[head & (Capacity - 1)]);
+        read_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Number of elements waiting, may be stale by the time it is read.
+     */
+    size_t size() const {
+        // The read index never passes the write index, so reading it first
+        // keeps the difference from wrapping if a pop lands in between
+        const size_t head = read_index.load(std::memory_order_acquire);
+        const size_t tail = write_index.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    /**
+     * @brief The largest number of elements that have been waiting at once.
+     */
+    size_t maxDepth() const {
+        return max_depth.load(std::memory_order_relaxed);
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+  private:
+    // Producer and consumer indices on separate cache lines so the two
+    // threads do not invalidate each other's line on every operation
+    alignas(64) std::atomic<size_t> read_index{0};
+    alignas(64) std::atomic<size_t> write_index{0};
+    alignas(64) std::atomic<size_t> max_depth{0};
+    std::array<T, Capacity> slots;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef STARTUP_TIMELINE_HPP
+#define STARTUP_TIMELINE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Records when each step of start up finished, relative to when the
+ * program started, so that slow steps and the time until the drone is first
+ * steered by the tracker can be measured.
+ *
+ * Marks can be made from any thread. Only start up steps and one-off events
+ * should be marked, each mark allocates.
+ */
+class StartupTimeline {
+    using Clock = std::chrono::steady_clock;
+
+  public:
+    StartupTimeline() : start(Clock::now()) {}
+
+    /**
+     * @brief Record that an event has happened now. Only the first mark of
+     * each event is kept.
+     *
+     * @param   event   The name of the event
+     * @return          `false` if the event had already been marked
+     */
+    bool mark(const std::string &event) {
+        const double ms =
+            std::chrono::duration<double, std::milli>(Clock::now() - start)
+                .count();
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &entry : events) {
+            if (entry.first == event) {
+                return false;
+            }
+        }
+        events.emplace_back(event, ms);
+        return true;
+    }
+
+    /**
+     * @brief Time from start to an event.
+     *
+     * @param   event   The name of the event
+     * @return          Milliseconds, or a negative value if not marked yet
+     */
+    double at(const std::string &event) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &entry : events) {
+            if (entry.first == event) {
+                return entry.second;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Print every event in the order they happened, with the time
+     * since start and since the previous event.
+     *
+     * @param   out     The stream to print to
+     */
+    void print(std::ostream &out) const {
+        std::vector<std::pair<std::string, double>> sorted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sorted = events;
+        }
+        std::stable_sort(
+            sorted.begin(), sorted.end(),
+            [](const auto &a, const auto &b) { return a.second < b.second; });
+        out << "Start up timeline:" << std::endl;
+        double previous = 0;
+        for (const auto &entry : sorted) {
+            out << "  " << entry.first << " " << entry.second << "ms (+"
+                << entry.second - previous << "ms)" << std::endl;
+            previous = entry.second;
+        }
+    }
+
+  private:
+    Clock::time_point start;
+    mutable std::mutex mutex;
+    std::vector<std::pair<std::string, double>> events;
+};
+
+#endif
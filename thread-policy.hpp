@@ -0,0 +1,113 @@
+#ifndef THREAD_POLICY_HPP
+#define THREAD_POLICY_HPP
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * @brief How the scheduler should treat one thread: the cores it may run on,
+ * and either a real-time `SCHED_FIFO` priority, which runs it ahead of every
+ * normal thread as soon as it wakes, or a nice value. Applied by the thread
+ * itself with `apply`.
+ */
+struct ThreadPolicy {
+    // Cores the thread may run on, any if empty
+    std::vector<int> cpus;
+    // `SCHED_FIFO` priority from 1 to 99, 0 to stay `SCHED_OTHER`
+    int fifo = 0;
+    // Nice value from -20 to 19 when not real-time, lower runs sooner
+    int nice = 0;
+
+    bool isDefault() const { return cpus.empty() && fifo == 0 && nice == 0; }
+
+    /**
+     * @brief Apply the policy to the calling thread. Each setting is tried on
+     * its own, a real-time priority or a negative nice value needs root or
+     * `CAP_SYS_NICE`.
+     *
+     * @param   error   Set to what could not be applied, if anything
+     * @return          Whether every setting was applied
+     */
+    bool apply(std::string &error) const {
+        error.clear();
+        if (!cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus) {
+                CPU_SET(cpu, &set);
+            }
+            const int result =
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if (result != 0) {
+                error += std::string("affinity: ") + std::strerror(result);
+            }
+        }
+        if (fifo > 0) {
+            sched_param param{};
+            param.sched_priority = fifo;
+            const int result =
+                pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (result != 0) {
+                error += std::string(error.empty() ? "" : ", ") +
+                         "SCHED_FIFO: " + std::strerror(result);
+            }
+        } else if (nice != 0) {
+            // On Linux nice is per thread, set through its thread id
+            const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+            if (setpriority(PRIO_PROCESS, tid, nice) != 0) {
+                error += std::string(error.empty() ? "" : ", ") +
+                         "nice: " + std::strerror(errno);
+            }
+        }
+        return error.empty();
+    }
+};
+
+/**
+ * @brief Parse a list of cores, e.g. `2`, `0-3` or `0,2-3`.
+ *
+ * @return  `false` if the list is malformed
+ */
+inline bool parseCpus(const std::string &text, std::vector<int> &cpus) {
+    cpus.clear();
+    size_t start = 0;
+    while (start <= text.size()) {
+        const size_t end = std::min(text.find(',', start), text.size());
+        const std::string item = text.substr(start, end - start);
+        const size_t dash = item.find('-');
+        char *rest = nullptr;
+        const long first = std::strtol(item.c_str(), &rest, 10);
+        long last = first;
+        if (rest == item.c_str() ||
+            (dash == std::string::npos ? *rest != '\0' : *rest != '-')) {
+            return false;
+        }
+        if (dash != std::string::npos) {
+            const char *second = item.c_str() + dash + 1;
+            last = std::strtol(second, &rest, 10);
+            if (rest == second || *rest != '\0') {
+                return false;
+            }
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        start = end + 1;
+    }
+    return !cpus.empty();
+}
+
+#endif
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <string>
+
+#include "tracking-core.hpp"
+
+/**
+ * @brief Check a condition, printing what failed.
+ *
+ * @return  The condition
+ */
+bool expect(bool condition, const std::string &what) {
+    if (!condition) {
+        std::cout << "FAILED " << what << std::endl;
+    }
+    return condition;
+}
+
+/**
+ * @brief Feed a gate failed updates until it searches.
+ */
+void startSearching(TrackGate &gate) {
+    for (int i = 0; i < TrackGate::SEARCH_FRAMES; i++) {
+        gate.update(false, -1);
+    }
+}
+
+int main() {
+    bool passed = true;
+
+    // A run of confident frames brings a search back to tracking
+    TrackGate gate;
+    startSearching(gate);
+    passed &= expect(gate.current() == TrackState::Searching,
+                     "searching after failed updates");
+    for (int i = 0; i < TrackGate::REACQUIRE_FRAMES; i++) {
+        gate.update(true, -1);
+    }
+    passed &= expect(gate.current() == TrackState::Tracking,
+                     "tracking after a run of confident frames");
+
+    // A tracker confident on one frame in four never reacquires, and the
+    // search ends in lost rather than going on for ever
+    gate.reset();
+    startSearching(gate);
+    for (int i = 0; i < 2 * TrackGate::LOST_FRAMES; i++) {
+        gate.update(i % 4 == 0, -1);
+        passed &= expect(gate.current() != TrackState::Tracking,
+                         "no tracking on a flickering tracker");
+    }
+    passed &= expect(gate.current() == TrackState::Lost,
+                     "lost on a flickering tracker");
+
+    std::cout << (passed ? "passed" : "failed") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+#ifndef TRACKER_STARTER_HPP
+#define TRACKER_STARTER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/tracking.hpp>
+
+#include "pipeline.hpp"
+#include "tracking-core.hpp"
+
+/**
+ * @brief Starts a tracker on a new target on a thread of its own, so the
+ * track stage keeps passing frames on while an expensive `init` runs. The
+ * tracker is initialised on the frame the target was selected on, then
+ * updated on every frame handed over with `follow` since, until it has
+ * nothing left to catch up on. Only then does `follow` report it ready, so
+ * the track stage takes over a tracker which is at most a frame behind.
+ *
+ * Waiting frames are held with their pool buffers, so only the newest
+ * `CATCH_UP_FRAMES` are kept; the tracker skips any older ones.
+ */
+class TrackerStarter {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t CATCH_UP_FRAMES = 8;
+
+    ~TrackerStarter() { join(); }
+
+    /**
+     * @brief Start initialising a tracker. The caller must not use it until
+     * `follow` reports it ready.
+     *
+     * @param   tracker The tracker
+     * @param   packet  The frame the target was selected on
+     * @param   roi     The target, in full size pixels
+     * @param   scale   The scale the tracker works at
+     */
+    void start(const cv::Ptr<cv::Tracker> &tracker, const FramePacket &packet,
+               const cv::Rect &roi, double scale) {
+        join();
+        this->tracker = tracker;
+        this->scale = scale;
+        target = roi;
+        tracked = true;
+        first = packet;
+        frames.clear();
+        caught_up = 0;
+        skipped = 0;
+        started = Clock::now();
+        done = false;
+        pending = true;
+        thread = std::thread(&TrackerStarter::run, this);
+    }
+
+    /**
+     * @brief Hand over a frame which came after the selected one.
+     *
+     * @return  `true` once the tracker has caught up, the frame was not taken
+     * and should be tracked by the caller
+     */
+    bool follow(const FramePacket &packet) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (done) {
+            return true;
+        }
+        if (frames.size() == CATCH_UP_FRAMES) {
+            frames.pop_front();
+            skipped++;
+        }
+        frames.push_back(packet);
+        return false;
+    }
+
+    /**
+     * @brief Stop the thread once `follow` has reported the tracker ready.
+     *
+     * @param   roi     Set to the target on the last frame caught up on
+     * @return          Whether the tracker still had the target then
+     */
+    bool finish(cv::Rect &roi) {
+        join();
+        roi = target;
+        return tracked;
+    }
+
+    // Whether a tracker has been started and not yet finished
+    bool isPending() const { return pending; }
+
+    // Frames updated on and skipped while catching up, and the time from
+    // `start` to being ready
+    std::uint64_t caughtUp() const { return caught_up; }
+    std::uint64_t skippedFrames() const { return skipped; }
+    double readyMs() const {
+        return std::chrono::duration<double, std::milli>(ready - started)
+            .count();
+    }
+
+  private:
+    void join() {
+        if (thread.joinable()) {
+            thread.join();
+        }
+        pending = false;
+    }
+
+    // The frame as the tracker sees it
+    const cv::Mat &input(const cv::Mat &frame) {
+        if (scale == 1) {
+            return frame;
+        }
+        cv::resize(frame, scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+        return scaled;
+    }
+
+    void run() {
+        tracker->init(input(first.frame), scaleRect(target, scale));
+        first = FramePacket();
+        cv::Rect box = scaleRect(target, scale);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!frames.empty()) {
+            // The track stage only appends while this works on the front
+            FramePacket packet = std::move(frames.front());
+            frames.pop_front();
+            lock.unlock();
+            tracked = tracker->update(input(packet.frame), box);
+            target = scaleRect(box, 1 / scale);
+            caught_up++;
+            packet = FramePacket();
+            lock.lock();
+        }
+        ready = Clock::now();
+        done = true;
+    }
+
+    cv::Ptr<cv::Tracker> tracker;
+    double scale = 1;
+    cv::Mat scaled;
+    FramePacket first;
+    // Written by the thread, read once it is joined
+    cv::Rect target;
+    bool tracked = false;
+    std::uint64_t caught_up = 0;
+    Clock::time_point started;
+    Clock::time_point ready;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::deque<FramePacket> frames;
+    std::uint64_t skipped = 0;
+    bool done = false;
+    bool pending = false;
+};
+
+#endif
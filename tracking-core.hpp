@@ -0,0 +1,565 @@
+#ifndef TRACKING_CORE_HPP
+#define TRACKING_CORE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <string>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/tracking.hpp>
+
+#include "cf-tracker.hpp"
+#include "drone-command.hpp"
+#include "pid-controller.hpp"
+
+// Shared by the live applications and the offline tools, so that they all
+// generate commands and make safety decisions in exactly the same way.
+
+// The frame size is 960x720, assume drone is at centre
+const cv::Point2i DRONE_POSITION(480, 360);
+// Amount of centimeters to move per pixel
+constexpr float CM_PER_PIXEL = 0.3;
+// Minimum centimeters the drone can move, defined in tello SDK
+constexpr int MIN_STEP = 20;
+// Maximum centimeters the drone can move
+constexpr int MAX_STEP = 60;
+// Multiplier for max size of roi
+const float ROI_MAX = 0.7;
+// Multiplier for min size of roi
+const float ROI_MIN = 0.05;
+// Acceptable range multiplier of roi size
+constexpr float ROI_SCALE = 0.2;
+// Lowest tracker confidence commands are sent at, for backends which report
+// one. For the correlation filter this is its peak-to-sidelobe ratio, a little
+// above the level where it stops updating
+const float MIN_CONFIDENCE = 10;
+
+/**
+ * @brief Create a tracker by name.
+ *
+ * @param   name    The tracker backend, `csrt`, `kcf` or `cf`
+ * @return          The tracker, or an empty pointer if the name is unknown
+ */
+inline cv::Ptr<cv::Tracker> createTracker(const std::string &name) {
+    if (name == "csrt") {
+        return cv::TrackerCSRT::create();
+    } else if (name == "kcf") {
+        return cv::TrackerKCF::create();
+    } else if (name == "cf") {
+        return TrackerCF::create();
+    }
+    return nullptr;
+}
+
+/**
+ * @brief The confidence of the tracker's last update, where the backend
+ * reports one.
+ *
+ * @param   tracker The tracker
+ * @return          The confidence, or a negative value if the backend has none
+ */
+inline float trackerConfidence(const cv::Ptr<cv::Tracker> &tracker) {
+    if (const auto *cf = dynamic_cast<const TrackerCF *>(tracker.get())) {
+        return cf->getConfidence();
+    }
+    return -1;
+}
+
+/**
+ * @brief Move a tracker's search window by the shift of the whole image.
+ * Only `TrackerCF` takes a hint, the OpenCV trackers search around their
+ * last result regardless.
+ *
+ * @return  Whether the tracker was moved
+ */
+inline bool shiftTracker(const cv::Ptr<cv::Tracker> &tracker,
+                         cv::Point2f shift) {
+    if (auto *cf = dynamic_cast<TrackerCF *>(tracker.get())) {
+        cf->translate(shift);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Scale a rectangle, keeping it at least a pixel wide and high.
+ */
+inline cv::Rect scaleRect(const cv::Rect &rect, double scale) {
+    return cv::Rect(cvRound(rect.x * scale), cvRound(rect.y * scale),
+                    std::max(1, cvRound(rect.width * scale)),
+                    std::max(1, cvRound(rect.height * scale)));
+}
+
+/**
+ * @brief What the drone should be doing given how well the target is being
+ * tracked.
+ *
+ * `Tracking`   Confident, commands are sent as normal
+ * `Holding`    Briefly unsure, no new commands, the drone hovers
+ * `Searching`  Lost for a while, the drone turns slowly towards where the
+ *              target was last seen
+ * `Lost`       Lost for too long, the drone hovers until a new target is
+ *              selected
+ */
+enum class TrackState { Tracking, Holding, Searching, Lost };
+
+inline const char *trackStateName(TrackState state) {
+    switch (state) {
+    case TrackState::Tracking:
+        return "tracking";
+    case TrackState::Holding:
+        return "holding";
+    case TrackState::Searching:
+        return "searching";
+    case TrackState::Lost:
+        return "lost";
+    }
+    return "";
+}
+
+/**
+ * @brief Decides the `TrackState` from the tracker's result on each frame, so
+ * that a failed or doubtful update never turns into a drone movement.
+ */
+class TrackGate {
+  public:
+    // Frames, at 30fps, of failed updates before searching and giving up
+    static constexpr int SEARCH_FRAMES = 15;
+    static constexpr int LOST_FRAMES = 300;
+    // Confident frames in a row needed to resume after searching
+    static constexpr int REACQUIRE_FRAMES = 5;
+
+    /**
+     * @brief Update the state with the result of a tracker update.
+     *
+     * @param   tracked     The tracker's update succeeded
+     * @param   confidence  From `trackerConfidence`, negative if unknown
+     * @return              The new state
+     */
+    TrackState update(bool tracked, float confidence) {
+        const bool confident =
+            tracked && (confidence < 0 || confidence >= MIN_CONFIDENCE);
+        if (state == TrackState::Lost) {
+            return state;
+        }
+        if (confident) {
+            sure++;
+            // While searching only a run of confident frames counts, so a
+            // tracker which is confident now and then still ends up lost
+            if (state != TrackState::Searching || sure >= REACQUIRE_FRAMES) {
+                unsure = 0;
+            }
+            if (state == TrackState::Holding || sure >= REACQUIRE_FRAMES) {
+                state = TrackState::Tracking;
+            }
+        } else {
+            sure = 0;
+            unsure++;
+            if (unsure >= LOST_FRAMES) {
+                state = TrackState::Lost;
+            } else if (unsure >= SEARCH_FRAMES) {
+                state = TrackState::Searching;
+            } else if (state == TrackState::Tracking) {
+                state = TrackState::Holding;
+            }
+        }
+        return state;
+    }
+
+    TrackState current() const { return state; }
+
+    /**
+     * @brief Start again for a new target.
+     */
+    void reset() {
+        state = TrackState::Tracking;
+        sure = 0;
+        unsure = 0;
+    }
+
+  private:
+    TrackState state = TrackState::Tracking;
+    // Confident and unsure updates in a row
+    int sure = 0;
+    int unsure = 0;
+};
+
+/**
+ * @brief The parameters of `Steer` and `LongitudinalMove`, as compile time
+ * constants so that the controller is specialised for them. Pass a struct of
+ * the same shape to try other values.
+ */
+struct ControlParams {
+    static constexpr float CM_PER_PIXEL = ::CM_PER_PIXEL;
+    static constexpr int MIN_STEP = ::MIN_STEP;
+    static constexpr int MAX_STEP = ::MAX_STEP;
+    static constexpr float ROI_SCALE = ::ROI_SCALE;
+};
+
+/**
+ * @brief Generates a command based off the drone position and the centre of
+ * the ROI around the object being tracked. Moves are between
+ * `Params::MIN_STEP` and `Params::MAX_STEP` cm, `Params::CM_PER_PIXEL` cm per
+ * pixel of error.
+ *
+ * @param   origin          The position of the drone
+ * @param   target          The centre of the ROI around the object being
+ * tracked
+ * @return                  A pair containing the `command`, empty if the
+ * movement is less than the minimum step, and the `velocity` as a point
+ */
+template <typename Params = ControlParams>
+inline std::pair<DroneCommand, cv::Point2i> Steer(const cv::Point2i &origin,
+                                                  const cv::Point2i &target) {
+    const cv::Point2i velocity{target - origin};
+    // Horizontal difference larger than vertical difference
+    const bool horizontal = abs(velocity.x) > abs(velocity.y);
+    const int error = horizontal ? velocity.x : velocity.y;
+    // Convert pixel velocity to cm velocity and absolute the value
+    const int step = abs(static_cast<int>(error * Params::CM_PER_PIXEL));
+    if (step <= Params::MIN_STEP) {
+        // Return an empty command if movement is less than minimum step
+        return {DroneCommand(), velocity};
+    }
+    // Right or left depending on sign of velocity, or up or down
+    const Verb verb = horizontal ? (error > 0 ? Verb::Right : Verb::Left)
+                                 : (error < 0 ? Verb::Up : Verb::Down);
+    return {DroneCommand::move(verb, std::min(step, Params::MAX_STEP)),
+            velocity};
+}
+
+/**
+ * @brief Generates a command to move the drone longitudinally by
+ * `Params::MIN_STEP`, based on the size of the ROI compared to the initial
+ * size of the ROI. The acceptable size is 1 +/- `Params::ROI_SCALE` times
+ * the initial size.
+ *
+ * @param   original_size   The size of the ROI when it was initialised
+ * @param   target_size     The size of the target object in the current frame
+ * @return                  The command, empty if no movement is needed
+ */
+template <typename Params = ControlParams>
+inline DroneCommand LongitudinalMove(const cv::Size &original_size,
+                                     const cv::Size &target_size) {
+    // The average ratio of height and width of the two Size objects
+    float ratio =
+        ((static_cast<float>(target_size.width) / original_size.width) +
+         ((static_cast<float>(target_size.height)) / original_size.height)) /
+        2;
+
+    /// Move backwards if target is > 1.2 times the initial size
+    // Move forwards if target is < 0.8 times the initial size
+    // Don't move longitudinally
+    if (ratio > 1 + Params::ROI_SCALE) {
+        return DroneCommand::move(Verb::Back, Params::MIN_STEP);
+    } else if (ratio < 1 - Params::ROI_SCALE) {
+        return DroneCommand::move(Verb::Forward, Params::MIN_STEP);
+    }
+    return DroneCommand();
+}
+
+// Period between `rc` velocity commands, 20Hz, seconds
+constexpr double RC_PERIOD = 0.05;
+// Longest step the `rc` controller integrates over, so a stall is not taken
+// for a long-standing error
+constexpr double RC_MAX_STEP = 3 * RC_PERIOD;
+// Searching for a lost target, turn towards where it was last seen: discrete
+// turns of SEARCH_STEP degrees up to SEARCH_TURN in total, or `rc` yaw at
+// SEARCH_YAW for SEARCH_TIME seconds
+constexpr int SEARCH_STEP = 15;
+constexpr int SEARCH_TURN = 90;
+constexpr int SEARCH_YAW = 20;
+constexpr double SEARCH_TIME = 3;
+// Image shift per frame, in pixels, below which the camera is taken to have
+// stopped moving, and `Steer` may act on what it sees
+constexpr float EGO_SETTLED = 3.0f;
+
+/**
+ * @brief What `FollowControl` decided on one frame.
+ */
+struct ControlOutput {
+    // The command for the frame, shown and recorded even when not sent
+    DroneCommand command;
+    // Whether `command` should be sent now
+    bool send = false;
+    // The planar error being corrected, from the drone position, and
+    // whether the command is a planar movement
+    cv::Point2i velocity;
+    bool planar = false;
+    // A move was held back as the image was still shifting from the last
+    bool settling = false;
+};
+
+/**
+ * @brief The control step run on every frame, shared by the live control
+ * stage, the simulator and batch replay so that they all fly the same
+ * controller: the `TrackGate` decides the state, then the `rc` controller or
+ * `Steer`/`LongitudinalMove` follow the target while tracking, and the drone
+ * turns towards where it was last seen while searching.
+ *
+ * The `rc` controller is reset and its clock restarted whenever tracking
+ * starts or resumes, so it never integrates over a hold, a search or the
+ * time before a target, and each step is capped at `RC_MAX_STEP`.
+ */
+class FollowControl {
+  public:
+    explicit FollowControl(bool rc) : rc(rc) {}
+
+    /**
+     * @brief Start again for a new target.
+     */
+    void reset() {
+        gate.reset();
+        rc_running = false;
+    }
+
+    /**
+     * @brief Decide what to do on a frame.
+     *
+     * @param   time        Seconds on a steady clock
+     * @param   roi         The tracked target, empty if there is none
+     * @param   roi_size    The size of the target when it was selected
+     * @param   tracked     The tracker's update succeeded
+     * @param   confidence  From `trackerConfidence`, negative if unknown
+     * @param   airborne    Whether the drone can be moved yet
+     * @param   busy        The drone has not acknowledged its last command
+     * @param   ego_shift   The image shift caused by the drone's own motion
+     * @return              The command and how it was made
+     */
+    ControlOutput step(double time, const cv::Rect &roi,
+                       const cv::Size &roi_size, bool tracked,
+                       float confidence, bool airborne, bool busy,
+                       cv::Point2f ego_shift = cv::Point2f()) {
+        const bool has_target = roi.width > 0 && roi.height > 0;
+        if (has_target) {
+            const TrackState previous = gate.current();
+            if (gate.update(tracked, confidence) == TrackState::Searching &&
+                previous != TrackState::Searching) {
+                search_turned = 0;
+                search_start = time;
+            }
+        }
+        const TrackState state = gate.current();
+
+        ControlOutput out;
+        const bool following =
+            airborne && has_target && state == TrackState::Tracking;
+        if (!following) {
+            rc_running = false;
+        }
+        if (following) {
+            const cv::Point2i object_centre = (roi.br() + roi.tl()) / 2;
+            last_side = object_centre.x < DRONE_POSITION.x ? -1 : 1;
+            if (rc) {
+                // Stream velocity setpoints at a fixed rate, starting from
+                // rest with a single period to integrate
+                const bool resumed = !rc_running;
+                if (resumed) {
+                    rc_controller.reset();
+                    last_rc = time - RC_PERIOD;
+                    rc_running = true;
+                }
+                if (resumed || time - last_rc >= RC_PERIOD) {
+                    const float dt = std::min(time - last_rc, RC_MAX_STEP);
+                    last_rc = time;
+                    rc_setpoint = rc_controller.update(
+                        DRONE_POSITION, roi, roi_size, dt, ROI_SCALE);
+                    out.command = DroneCommand::rc(rc_setpoint);
+                    out.send = true;
+                }
+                // Both axes are corrected together
+                out.velocity = object_centre - DRONE_POSITION;
+                out.planar = true;
+            } else {
+                const auto steer = Steer(DRONE_POSITION, object_centre);
+                out.command = steer.first;
+                if (!out.command.empty()) {
+                    out.velocity = steer.second;
+                    out.planar = true;
+                } else {
+                    // If no planar movement needed check for longitudinal
+                    out.command = LongitudinalMove(roi_size, roi.size());
+                }
+                // While the image is still shifting from the last move the
+                // target's position is not where the drone will end up, so
+                // wait for it to settle rather than correct twice
+                const bool settled =
+                    std::hypot(ego_shift.x, ego_shift.y) <= EGO_SETTLED;
+                out.settling = !out.command.empty() && !busy && !settled;
+                out.send = !out.command.empty() && !busy && settled;
+            }
+        } else if (airborne && has_target && state == TrackState::Searching &&
+                   (rc ? time - search_start < SEARCH_TIME
+                       : search_turned < SEARCH_TURN)) {
+            // Turn slowly towards where the target was last seen, the tracker
+            // keeps looking and the gate resumes tracking once it is confident
+            if (rc) {
+                if (rc_setpoint.yaw != last_side * SEARCH_YAW) {
+                    rc_setpoint = RCSetpoint();
+                    rc_setpoint.yaw = last_side * SEARCH_YAW;
+                    out.command = DroneCommand::rc(rc_setpoint);
+                }
+            } else if (!busy) {
+                out.command = DroneCommand::move(
+                    last_side > 0 ? Verb::Cw : Verb::Ccw, SEARCH_STEP);
+                search_turned += SEARCH_STEP;
+            }
+            out.send = !out.command.empty();
+        } else if (rc && !rc_setpoint.isZero()) {
+            // Nothing is being tracked confidently, stop the drone where it is
+            rc_setpoint = RCSetpoint();
+            out.command = DroneCommand::rc(rc_setpoint);
+            out.send = true;
+        }
+        return out;
+    }
+
+    TrackState state() const { return gate.current(); }
+
+  private:
+    bool rc;
+    TrackGate gate;
+    RCController rc_controller;
+    RCSetpoint rc_setpoint;
+    double last_rc = 0;
+    // Whether the controller has run since tracking last started or resumed
+    bool rc_running = false;
+    // Side of the frame the target was last seen on, -1 left and 1 right, and
+    // when the search started and how far it has turned so far
+    int last_side = 1;
+    double search_start = 0;
+    int search_turned = 0;
+};
+
+/**
+ * Draws arrows to represent the movement of the drone.
+ * Green arrow is the movement the drone is making,
+ * the red arrow is movement the drone is not making.
+ *
+ * @param   image       The current image
+ * @param   drone_pos   The position of the drone
+ * @param   velocity    The movement needed for drone_pos to match the object's
+ * position
+ */
+inline void drawMovement(cv::Mat &image, const cv::Point2i &drone_pos,
+                         const cv::Point2i &velocity) {
+    // Define two points for the horizontal and vertical velocity values
+    const cv::Point2i x_pos(drone_pos.x + velocity.x, drone_pos.y);
+    const cv::Point2i y_pos(drone_pos.x, drone_pos.y + velocity.y);
+    /// Draw the arrows, colour depends on which value is larger
+    // Green for larger (movement drone has selected)
+    // Red for smaller (movement not selected)
+    if (abs(velocity.x) > abs(velocity.y)) {
+        cv::arrowedLine(image, drone_pos, x_pos, {0, 255, 0});
+        cv::arrowedLine(image, drone_pos, y_pos, {0, 0, 255});
+    } else {
+        cv::arrowedLine(image, drone_pos, x_pos, {0, 0, 255});
+        cv::arrowedLine(image, drone_pos, y_pos, {0, 255, 0});
+    }
+}
+
+/**
+ * @brief Draw the tracked object and the movement generated for it: blue
+ * while tracking, yellow while holding and red while searching or lost.
+ *
+ * @param   image       The image to draw on
+ * @param   roi         The tracked object, nothing is drawn if empty
+ * @param   state       The tracking state
+ * @param   rc          Whether the `rc` controller generated the command
+ * @param   velocity    The planar movement, from the drone position
+ * @param   planar      Whether the command is a planar movement
+ * @param   command     The command, if any
+ */
+inline void drawTracking(cv::Mat &image, const cv::Rect &roi,
+                         TrackState state, bool rc,
+                         const cv::Point2i &velocity, bool planar,
+                         const DroneCommand &command) {
+    if (roi.width <= 0 || roi.height <= 0) {
+        return;
+    }
+    const cv::Point2i object_centre = (roi.br() + roi.tl()) / 2;
+    if (state != TrackState::Tracking) {
+        const cv::Scalar colour = state == TrackState::Holding
+                                      ? cv::Scalar(0, 255, 255)
+                                      : cv::Scalar(0, 0, 255);
+        cv::rectangle(image, roi, colour, 2, 1);
+        cv::putText(image, trackStateName(state), roi.tl() - cv::Point(0, 6),
+                    cv::FONT_HERSHEY_SIMPLEX, 0.6, colour, 2);
+        return;
+    }
+    cv::rectangle(image, roi, cv::Scalar(255, 0, 0), 2, 1);
+    cv::circle(image, object_centre, 3, cv::Scalar(255, 0, 0));
+
+    if (rc) {
+        // Draw the planar error, both axes are corrected together
+        cv::arrowedLine(image, DRONE_POSITION, DRONE_POSITION + velocity,
+                        {0, 255, 0});
+    } else if (planar) {
+        // Draw velocity lines (green for selected red for not selected)
+        drawMovement(image, DRONE_POSITION, velocity);
+    } else if (command.verb == Verb::Forward) {
+        // Draw forwards backwards movement
+        cv::rectangle(image, roi, cv::Scalar(0, 255, 0), 2, 1);
+    } else if (command.verb == Verb::Back) {
+        cv::rectangle(image, roi, cv::Scalar(0, 0, 255), 2, 1);
+    }
+}
+
+/**
+ * @brief Check if the defined ROI is within the allowed size range.
+ *
+ * @param   roi_size      The size of the current defined ROI
+ * @param   frame_width   The width of the frame
+ * @param   frame_height  The height of the frame
+ * @param   roi_min       The multiplier to calculate minimum roi size
+ * @param   roi_max       The multiplier to calculate maximum roi size
+ * @return                `true` - When the defined ROI is of an acceptable size
+ * @return                `false` - When the defined ROI is not of an acceptable
+ * size
+ */
+inline bool checkROI(cv::Size roi_size, int frame_width, int frame_height,
+                     const float roi_min, const float roi_max) {
+    if (roi_size.width > 0.7 * frame_width or
+        roi_size.height > 0.7 * frame_height) {
+        std::cout << "ROI too large, define area again" << std::endl;
+        return false;
+    } else if (roi_size.width < 0.05 * frame_width or
+               roi_size.height < 0.05 * frame_height) {
+        std::cout << "ROI too small, define area again" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Measures the rate of change of the roi, to determine if sudden change
+ * occurs.
+ *
+ * @param   roi         `cv::Rect` the current roi
+ * @param   history     The previous roi sizes, most recent first
+ * @return              `true` - When the rate of change is safe
+ * @return              `false` - When the rate of change is unsafe
+ */
+inline bool rocCheck(cv::Rect roi, std::deque<int> &history) {
+    history.push_front(roi.area());
+    if (history.size() > 20) {
+        history.pop_back();
+        float ratios[19];
+        for (int i = 0; i < history.size() - 1; i++) {
+            ratios[i] = static_cast<float>(history.at(i)) / history.at(i + 1);
+        }
+        float ratio_avg = 0;
+        for (float n : ratios) {
+            ratio_avg = ratio_avg + n;
+        }
+        ratio_avg = ratio_avg / 19;
+        if (!(ratio_avg < 1.1 and ratio_avg > 0.9)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
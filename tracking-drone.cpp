@@ -1,8 +1,18 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <deque>
+#include <fstream>
+#include <future>
 #include <iostream>
-#include <list>
+#include <map>
+#include <memory>
 #include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "ctello.h"
 #include <opencv2/core/utility.hpp>
@@ -12,47 +22,756 @@
 #include <opencv2/videoio.hpp>
 #include <opencv2/core/utils/filesystem.hpp>
 
-const char *const TELLO_STREAM_URL{"udp://0.0.0.0:11111"};
+#include "command-link.hpp"
+#include "crop-recorder.hpp"
+#include "detector.hpp"
+#include "ego-motion.hpp"
+#include "frame-check.hpp"
+#include "frame-pool.hpp"
+#include "frame-source.hpp"
+#include "latency-probe.hpp"
+#include "logging.hpp"
+#include "metrics-exporter.hpp"
+#include "pipeline.hpp"
+#include "quality-governor.hpp"
+#include "recorder.hpp"
+#include "startup-timeline.hpp"
+#include "tracker-starter.hpp"
+#include "thread-policy.hpp"
+#include "tracking-core.hpp"
+#include "vehicle.hpp"
+#include "worker-pool.hpp"
+
+// The drone's video port, the first session's stream is read from it and
+// later sessions use the ports after it
+const int TELLO_VIDEO_PORT = 11111;
+// The local command port of the first session, later sessions use the ports
+// after it
+const int LOCAL_COMMAND_PORT = 9000;
+// The drone's status port, sent along with a session's video port
+const int TELLO_STATUS_PORT = 8890;
+// The H.264 relay forwards a session's stream to its video port plus this,
+// on loopback
+const int RELAY_PORT_OFFSET = 1000;
 
 using namespace cv;
 using namespace ctello;
 
 // Variable instantiation
 
-// 0 for flight 1 for testing
+// Take off and send movement commands to a real drone, `fly`. Simulated
+// vehicles are always flown
 bool doFlight = false;
 
-// Used in drawing the ROI around the object
-bool selectObject = false;
-// Used to start object tracking or select new ROI
-int trackObject = 0;
-
-cv::Mat image;
-cv::Point2i origin;
-cv::Rect selection;
-// The frame size is 960x720, assume drone is at centre
-const cv::Point2i DRONE_POSITION(480, 360);
-// Amount of centimeters to move per pixel
-const float CM_PER_PIXEL = 0.3;
-// Minimum centimeters the drone can move, defined in tello SDK
-const int MIN_STEP = 20;
-// Maximum centimeters the drone can move
-const int MAX_STEP = 60;
-// default output filenames
-const std::string CLEAN = "../video-output/out.avi";
-const std::string DIRTY = "../video-output/out_dirty.avi";
-// starting size of roi
-cv::Size roi_size;
-// Multiplier for max size of roi
-const float ROI_MAX = 0.7;
-// Multiplier for min size of roi
-const float ROI_MIN = 0.05;
-// Acceptable range multiplier of roi size
-const float ROI_SCALE = 0.2;
-// Datastructure that holds the previous roi sizes
-std::deque<int> prevs_roi_size;
+// Where recordings are saved, and the default recording name, numbered when
+// there are several sessions
+const std::string OUTPUT_DIR = "../video-output/";
+std::string outputName = "out";
+// Codec for the clean video, the overlay video uses it too unless it is H.264
+// passthrough, which only exists for the clean stream
+Codec recordCodec = Codec::MJPG;
+// When recordings are split into a new file, not at all by default
+SegmentPolicy segmentPolicy;
 // Save the video output with overlay or not
 bool saveDirty = false;
+// Save a window around the target, a thumbnail and the overlays as data,
+// see `CropRecorder`
+bool saveCrop = false;
+// Use the continuous `rc` controller instead of `Steer`/`LongitudinalMove`
+bool rcControl = false;
+// Estimate the image shift caused by the drone's own motion, see `EgoMotion`
+bool egoMotion = false;
+// Keep duplicate and corrupt frames from the tracker, see `FrameCheck`
+bool checkFrames = false;
+// ONNX model for re-detecting the target, none by default, see
+// `AsyncDetector`, and the side of its input
+std::string detectorModel;
+int detectorSize = 320;
+// Frames between detections while the tracker is confident, a detection is
+// also started on any frame where it is not and the detector is idle
+int detectEvery = 30;
+// Overlap with the ROI on the detected frame for a detection to be taken as
+// the target, and overlap with the ROI below which the tracker is moved onto
+// it
+const float DETECT_MATCH = 0.3f;
+const float REANCHOR_BELOW = 0.6f;
+// Tracker backend, see `createTracker`
+std::string trackerName = "csrt";
+// Time allowed from capture to the end of tracking, quality is lowered to
+// keep frames within it, see `QualityGovernor`. 0 keeps full quality
+std::chrono::microseconds frameDeadline{0};
+// Loopback port the metrics exporter listens on, 0 to disable it. Later
+// sessions use the ports after it
+int metricsPort = 9464;
+// Measures glass-to-command latency when set, see `LatencyProbe`
+std::unique_ptr<LatencyProbe> latencyProbe;
+// Threads shared by the track and record stages of every session, 0 for one
+// per core, or per core they are pinned to
+unsigned workerCount = 0;
+// Cores and priority of each stage's threads, see `ThreadPolicy`. Track and
+// record share the worker pool's threads, so share a policy
+ThreadPolicy ingestPolicy;
+ThreadPolicy controlPolicy;
+ThreadPolicy workerPolicy;
+ThreadPolicy renderPolicy;
+// Threads OpenCV may use for its own parallel loops, -1 for its default. One
+// pool serves the whole process, so this cannot be set per stage
+int cvThreads = -1;
+// Lowest level of log message shown on the console, every level is kept in
+// memory and written to `tracking-drone.log` on exit
+spdlog::level::level_enum logLevel = spdlog::level::info;
+// Per-frame messages, such as each command, are logged at most once per
+// interval at the console level, the rest at debug
+const std::chrono::milliseconds LOG_INTERVAL{250};
+// Frame buffers in the pool. Worst case in flight is every queue full plus one
+// frame held by each stage: 16 clean + 2 track + 4 control + 4 render + 5
+// stage frames + 9 frames a new tracker starts on and catches up on, and 16
+// dirty + 3 overlay images
+const size_t FRAME_POOL_SIZE = 65;
+
+// Every heap allocation in the process, reported per frame with the pipeline
+// statistics. The steady state target is zero
+std::atomic<std::uint64_t> heapAllocations{0};
+
+void *operator new(std::size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+/**
+ * @brief The path of a recording, without the extension or segment number.
+ * This overwrites anything already saved under the same name.
+ *
+ * @param   name    The recording name, from the command line
+ * @param   dirty   The video with overlays, rather than the clean video
+ * @return          The path to write the video to
+ */
+std::string outputBase(const std::string &name, bool dirty) {
+    return OUTPUT_DIR + name + (dirty ? "_dirty" : "");
+}
+
+/**
+ * @brief The codec for the overlay video, which is always re-encoded.
+ */
+Codec dirtyCodec() {
+    return recordCodec == Codec::H264 ? Codec::MJPG : recordCodec;
+}
+
+/**
+ * @brief Run the tracker once on a synthetic frame, so that its first real
+ * `init` does not pay for loading code, allocating its buffers and OpenCV's
+ * lazy initialisation while the drone is waiting for it.
+ *
+ * @param   tracker The tracker to warm up, `init` resets it before real use
+ * @param   size    The size of the frames it will track
+ */
+void warmUpTracker(cv::Ptr<cv::Tracker> &tracker, cv::Size size) {
+    cv::Mat frame(size, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::Rect roi(size.width / 2 - 50, size.height / 2 - 50, 100, 100);
+    tracker->init(frame, roi);
+    tracker->update(frame, roi);
+}
+
+/**
+ * @brief The queues connecting the pipeline stages of one session and the
+ * flags that stop them. Every queue has exactly one producer and one
+ * consumer. Ingest and control have a thread each, track and record are
+ * tasks on the shared worker pool, which never runs a task on two threads at
+ * once.
+ *
+ * ingest -> track -> control -> render (main thread) -> record (dirty)
+ * ingest ----------------------------------------------> record (clean)
+ */
+struct Pipeline {
+    // Kept short so that tracking never works through a backlog of old frames
+    SPSCQueue<FramePacket, 2> track_queue;
+    SPSCQueue<FramePacket, 4> control_queue;
+    SPSCQueue<FramePacket, 4> render_queue;
+    // Every frame for the clean video, independent of tracking and display
+    SPSCQueue<FramePacket, 16> clean_queue;
+    SPSCQueue<FramePacket, 16> dirty_queue;
+    // New ROI selections from the mouse callback, render -> track
+    SPSCQueue<cv::Rect, 4> selection_queue;
+
+    StageStats ingest;
+    StageStats track;
+    StageStats control;
+    StageStats render;
+    StageStats record;
+
+    // Buffers for `frame` and `image`, shared by every stage
+    FramePool &pool;
+    // Counts `cv::Mat` allocations for the per-frame allocation report
+    const CountingMatAllocator &mat_allocations;
+
+    // Prefix for printed lines, names the session when there are several
+    const std::string label;
+    // The live stages log here rather than printing, see `Logging`
+    std::shared_ptr<spdlog::logger> log;
+
+    Pipeline(FramePool &pool, const CountingMatAllocator &mat_allocations,
+             const std::string &label)
+        : pool(pool), mat_allocations(mat_allocations), label(label) {}
+
+    // Tracker results, written by the track stage
+    std::atomic<std::uint64_t> tracker_updates{0};
+    std::atomic<std::uint64_t> tracker_failures{0};
+    // Frames on which commands were held back because the target was not
+    // tracked confidently, written by the control stage
+    std::atomic<std::uint64_t> frames_gated{0};
+    // Frames on which a discrete command waited for the camera to stop
+    // moving, written by the control stage
+    std::atomic<std::uint64_t> frames_moving{0};
+    // Detector results, and the times one moved the tracker, written by the
+    // track stage
+    std::atomic<std::uint64_t> detections{0};
+    std::atomic<std::uint64_t> redetections{0};
+    std::atomic<std::int64_t> detect_latency{0};
+    // The quality level, the times it has changed and the frames on which
+    // the tracker was not updated because of it, written by the track stage
+    std::atomic<int> quality_level{0};
+    std::atomic<std::uint64_t> quality_changes{0};
+    std::atomic<std::uint64_t> frames_coasted{0};
+    // Frames recorded but not tracked because they repeated the last frame or
+    // were damaged, written by the ingest stage
+    std::atomic<std::uint64_t> frames_duplicate{0};
+    std::atomic<std::uint64_t> frames_corrupt{0};
+    std::atomic<int> track_state{static_cast<int>(TrackState::Tracking)};
+    // Commands sent to the drone, and the round trip time from sending a
+    // command to its response, microseconds, written by the control stage
+    std::atomic<std::uint64_t> commands_sent{0};
+    std::atomic<std::uint64_t> responses{0};
+    std::atomic<std::uint64_t> rtt_samples{0};
+    std::atomic<std::int64_t> total_rtt{0};
+    std::atomic<std::int64_t> last_rtt{0};
+
+    // The record stage encodes the clean video, false when the H.264 relay
+    // records it instead
+    bool record_clean = true;
+    // What the stream was agreed to deliver, and when the pipeline started,
+    // for the capture rate
+    SourceFormat stream_format;
+    const Clock::time_point started = Clock::now();
+
+    // Cleared to stop the live stages
+    std::atomic<bool> running{true};
+    // Set once nothing more will be queued for the recorder
+    std::atomic<bool> upstream_done{false};
+    // Set by the record stage once its files are closed
+    std::atomic<bool> record_finished{false};
+};
+
+/**
+ * @brief Print the statistics of every stage and the depth of its input
+ * queue.
+ *
+ * @param   pipeline    The pipeline
+ */
+void printPipeline(const Pipeline &pipeline) {
+    if (!pipeline.label.empty()) {
+        std::cout << pipeline.label << "pipeline" << std::endl;
+    }
+    const double seconds =
+        std::chrono::duration<double>(Clock::now() - pipeline.started).count();
+    std::cout << "stream " << pipeline.stream_format << ", capturing "
+              << (seconds > 0 ? pipeline.ingest.processed / seconds : 0)
+              << "fps" << std::endl;
+    if (checkFrames) {
+        std::cout << "frames not tracked: " << pipeline.frames_duplicate
+                  << " duplicate, " << pipeline.frames_corrupt << " corrupt"
+                  << std::endl;
+    }
+    if (pipeline.quality_changes > 0) {
+        std::cout << "quality " << QUALITY_LEVELS[pipeline.quality_level].name
+                  << " after " << pipeline.quality_changes << " change(s), "
+                  << pipeline.frames_coasted << " frame(s) not tracked"
+                  << std::endl;
+    }
+    printStage("ingest", pipeline.ingest, 0, 0);
+    printStage("track", pipeline.track, pipeline.track_queue.size(),
+               pipeline.track_queue.maxDepth());
+    printStage("control", pipeline.control, pipeline.control_queue.size(),
+               pipeline.control_queue.maxDepth());
+    printStage("render", pipeline.render, pipeline.render_queue.size(),
+               pipeline.render_queue.maxDepth());
+    printStage("record", pipeline.record, pipeline.clean_queue.size(),
+               pipeline.clean_queue.maxDepth());
+}
+
+/**
+ * @brief Write the live metrics for the exporter. Called on the exporter's
+ * thread, only reads counters.
+ *
+ * Only counters and current values are served, rates are left to the
+ * scraper (e.g. `rate()`), so any number of scrapers see the same values.
+ *
+ * @param   pipeline    The pipeline
+ * @param   text        The page to write to
+ */
+void writeMetrics(const Pipeline &pipeline, MetricsText &text) {
+    const struct {
+        const char *name;
+        const StageStats &stats;
+        size_t depth;
+        size_t max_depth;
+    } stages[] = {
+        {"ingest", pipeline.ingest, 0, 0},
+        {"track", pipeline.track, pipeline.track_queue.size(),
+         pipeline.track_queue.maxDepth()},
+        {"control", pipeline.control, pipeline.control_queue.size(),
+         pipeline.control_queue.maxDepth()},
+        {"render", pipeline.render, pipeline.render_queue.size(),
+         pipeline.render_queue.maxDepth()},
+        {"record", pipeline.record, pipeline.clean_queue.size(),
+         pipeline.clean_queue.maxDepth()},
+    };
+    text.family("tracking_stage_frames_total", "counter",
+                "Frames processed by each stage");
+    for (const auto &stage : stages) {
+        text.sample("tracking_stage_frames_total", stage.stats.processed,
+                    "stage", stage.name);
+    }
+    text.family("tracking_stage_dropped_total", "counter",
+                "Frames dropped in front of each stage");
+    for (const auto &stage : stages) {
+        text.sample("tracking_stage_dropped_total", stage.stats.dropped,
+                    "stage", stage.name);
+    }
+    text.family("tracking_stage_latency_seconds", "summary",
+                "Capture to stage completion time");
+    for (const auto &stage : stages) {
+        text.sample("tracking_stage_latency_seconds_sum",
+                    stage.stats.total_latency / 1e6, "stage", stage.name);
+        text.sample("tracking_stage_latency_seconds_count",
+                    stage.stats.processed, "stage", stage.name);
+    }
+    text.family("tracking_stage_latency_mean_seconds", "gauge",
+                "Mean capture to stage completion time");
+    for (const auto &stage : stages) {
+        text.sample("tracking_stage_latency_mean_seconds",
+                    stage.stats.meanLatencyMs() / 1e3, "stage", stage.name);
+    }
+    text.family("tracking_stage_latency_max_seconds", "gauge",
+                "Largest capture to stage completion time");
+    for (const auto &stage : stages) {
+        text.sample("tracking_stage_latency_max_seconds",
+                    stage.stats.max_latency / 1e6, "stage", stage.name);
+    }
+    text.family("tracking_queue_depth", "gauge",
+                "Packets waiting in front of each stage");
+    for (const auto &stage : stages) {
+        text.sample("tracking_queue_depth", stage.depth, "stage", stage.name);
+    }
+    text.family("tracking_queue_max_depth", "gauge",
+                "Most packets that have waited in front of each stage");
+    for (const auto &stage : stages) {
+        text.sample("tracking_queue_max_depth", stage.max_depth, "stage",
+                    stage.name);
+    }
+
+    const double updates = pipeline.tracker_updates;
+    text.family("tracking_tracker_updates_total", "counter",
+                "Tracker updates");
+    text.sample("tracking_tracker_updates_total", updates);
+    text.family("tracking_tracker_failures_total", "counter",
+                "Tracker updates which lost the target");
+    text.sample("tracking_tracker_failures_total", pipeline.tracker_failures);
+    text.family("tracking_tracker_success_ratio", "gauge",
+                "Share of tracker updates which found the target");
+    text.sample("tracking_tracker_success_ratio",
+                updates > 0 ? 1 - pipeline.tracker_failures / updates : 1);
+
+    text.family("tracking_frames_gated_total", "counter",
+                "Frames on which commands were held back because the target "
+                "was not tracked confidently");
+    text.sample("tracking_frames_gated_total", pipeline.frames_gated);
+    text.family("tracking_frames_moving_total", "counter",
+                "Frames on which a discrete command waited for the camera "
+                "to stop moving");
+    text.sample("tracking_frames_moving_total", pipeline.frames_moving);
+    text.family("tracking_detections_total", "counter",
+                "Frames the re-detector has finished");
+    text.sample("tracking_detections_total", pipeline.detections);
+    text.family("tracking_redetections_total", "counter",
+                "Times a detection re-initialised the tracker");
+    text.sample("tracking_redetections_total", pipeline.redetections);
+    text.family("tracking_detection_latency_seconds", "gauge",
+                "Capture to result time of the last detection");
+    text.sample("tracking_detection_latency_seconds",
+                pipeline.detect_latency / 1e6);
+    text.family("tracking_frames_duplicate_total", "counter",
+                "Frames not tracked because they repeated the last frame");
+    text.sample("tracking_frames_duplicate_total", pipeline.frames_duplicate);
+    text.family("tracking_frames_corrupt_total", "counter",
+                "Frames not tracked because they were damaged in transit");
+    text.sample("tracking_frames_corrupt_total", pipeline.frames_corrupt);
+    text.family("tracking_quality_level", "gauge",
+                "Quality level, 0 full, higher is cheaper");
+    text.sample("tracking_quality_level", pipeline.quality_level);
+    text.family("tracking_quality_changes_total", "counter",
+                "Times the quality level changed");
+    text.sample("tracking_quality_changes_total", pipeline.quality_changes);
+    text.family("tracking_frames_coasted_total", "counter",
+                "Frames on which the tracker was skipped to save time");
+    text.sample("tracking_frames_coasted_total", pipeline.frames_coasted);
+    text.family("tracking_state", "gauge",
+                "0 tracking, 1 holding, 2 searching, 3 lost");
+    text.sample("tracking_state", pipeline.track_state);
+
+    text.family("tracking_commands_total", "counter",
+                "Commands sent to the drone");
+    text.sample("tracking_commands_total", pipeline.commands_sent);
+    text.family("tracking_responses_total", "counter",
+                "Responses received from the drone");
+    text.sample("tracking_responses_total", pipeline.responses);
+    text.family("tracking_rtt_seconds", "gauge",
+                "Round trip time of the last acknowledged command");
+    text.sample("tracking_rtt_seconds", pipeline.last_rtt / 1e6);
+    text.family("tracking_rtt_mean_seconds", "gauge",
+                "Mean round trip time of acknowledged commands");
+    text.sample("tracking_rtt_mean_seconds",
+                pipeline.rtt_samples > 0
+                    ? pipeline.total_rtt / 1e6 / pipeline.rtt_samples
+                    : 0);
+
+    text.family("tracking_frame_pool_available", "gauge",
+                "Frame buffers not lent out");
+    text.sample("tracking_frame_pool_available", pipeline.pool.available());
+}
+
+/**
+ * @brief Ingest stage. Reads frames from the stream and hands each one to the
+ * track stage and the clean recorder.
+ *
+ * @param   pipeline    The pipeline
+ * @param   source      The video stream
+ */
+void ingestStage(Pipeline &pipeline, FrameSource &source) {
+    std::uint64_t id = 0;
+    FrameCheck check;
+    LogLimit check_limit(LOG_INTERVAL);
+    std::uint64_t suppressed = 0;
+    while (pipeline.running) {
+        FramePacket packet;
+        // Decode straight into a pool buffer, if the pool has run dry the
+        // capture allocates a new frame instead
+        packet.frame_buffer = pipeline.pool.acquire();
+        packet.frame = packet.frame_buffer.mat();
+        // Stop the program if no more images
+        if (!source.read(packet.frame) || packet.frame.empty()) {
+            pipeline.log->info("event=stream_end frames={}", id);
+            pipeline.running = false;
+            break;
+        }
+        packet.id = id++;
+        packet.captured = Clock::now();
+        pipeline.ingest.record(packet.captured);
+
+        // The clean recorder shares the frame, neither side writes to it
+        if (pipeline.record_clean) {
+            FramePacket clean;
+            clean.id = packet.id;
+            clean.captured = packet.captured;
+            clean.frame = packet.frame;
+            clean.frame_buffer = packet.frame_buffer;
+            pushOrDrop(pipeline.clean_queue, clean, pipeline.record);
+        }
+        // Repeated and damaged frames are only recorded, they would cost a
+        // tracker update and could pull the tracker off the target
+        if (checkFrames) {
+            const FrameVerdict verdict = check.check(packet.frame);
+            if (verdict != FrameVerdict::Good) {
+                if (verdict == FrameVerdict::Duplicate) {
+                    pipeline.frames_duplicate++;
+                } else {
+                    pipeline.frames_corrupt++;
+                }
+                if (check_limit.allow(suppressed)) {
+                    pipeline.log->info("event=frame_rejected verdict={} "
+                                       "frame={} suppressed={}",
+                                       frameVerdictName(verdict), packet.id,
+                                       suppressed);
+                }
+                continue;
+            }
+        }
+        pushOrDrop(pipeline.track_queue, packet, pipeline.track);
+    }
+}
+
+/**
+ * @brief Control stage. Generates commands from the tracking result, sends
+ * them to the drone and listens for its responses.
+ *
+ * @param   pipeline    The pipeline
+ * @param   link        The drone's command link, only used by this stage
+ * while running
+ * @param   timeline    The session's start up timeline
+ */
+void controlStage(Pipeline &pipeline, CommandLink &link,
+                  StartupTimeline &timeline) {
+    // Take off from here rather than before the pipeline starts, so the
+    // stream is live and a target can be selected while the drone climbs. No
+    // command is sent until the drone acknowledges the takeoff
+    const bool fly = doFlight || link.simulated();
+    bool airborne = !fly;
+    // When the last command needing a response was sent, for the round trip
+    // time
+    Clock::time_point sent_at;
+    bool awaiting = false;
+    auto send = [&](std::string_view command, bool acknowledged) {
+        link.sendCommand(command);
+        pipeline.commands_sent++;
+        if (acknowledged) {
+            sent_at = Clock::now();
+            awaiting = true;
+        }
+    };
+    if (fly) {
+        send("takeoff", true);
+    }
+    // Commands are only turned into text here, as they are sent
+    CommandText text;
+    // Whether a command left for the drone on this frame
+    bool emitted = false;
+    // `rc` commands go out at 20Hz, every one is logged at debug only
+    LogLimit command_limit(LOG_INTERVAL);
+    std::uint64_t suppressed = 0;
+    auto emit = [&](const DroneCommand &command) {
+        const std::string_view serialised = text.format(command);
+        if (fly) {
+            send(serialised, command.acknowledged());
+        }
+        if (command_limit.allow(suppressed)) {
+            pipeline.log->info("event=command command=\"{}\" suppressed={}",
+                               serialised, suppressed);
+        } else {
+            pipeline.log->debug("event=command command=\"{}\"", serialised);
+        }
+        emitted = true;
+    };
+    bool busy = false;
+    // Whether a frame has been tracked yet, the timeline is only marked once
+    // as each mark allocates and locks
+    bool first_tracked = false;
+    // Gates commands on the tracker's confidence and generates them, as the
+    // simulator and batch replay do. Its clock is seconds since here
+    FollowControl control(rcControl);
+    const auto control_start = Clock::now();
+    FramePacket packet;
+    while (pipeline.running) {
+        // Listen for drone response, the drone can only move once it has
+        // completed its previous command
+        if (const auto response = link.receiveResponse()) {
+            pipeline.responses++;
+            if (awaiting) {
+                awaiting = false;
+                const std::int64_t rtt =
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        Clock::now() - sent_at)
+                        .count();
+                pipeline.last_rtt = rtt;
+                pipeline.total_rtt += rtt;
+                pipeline.rtt_samples++;
+                pipeline.log->debug("event=response response=\"{}\" "
+                                    "rtt_ms={:.1f}",
+                                    *response, rtt / 1000.0);
+            } else {
+                pipeline.log->debug("event=response response=\"{}\"",
+                                    *response);
+            }
+            if (!airborne) {
+                airborne = true;
+                timeline.mark("takeoff");
+            }
+            busy = false;
+        }
+        if (!pipeline.control_queue.tryPop(packet)) {
+            idle();
+            continue;
+        }
+        const TrackState previous = control.state();
+        if (packet.new_target) {
+            control.reset();
+        }
+
+        const cv::Rect &roi = packet.roi;
+        const bool has_target = roi.width > 0 && roi.height > 0;
+        emitted = false;
+        const ControlOutput out = control.step(
+            std::chrono::duration<double>(Clock::now() - control_start)
+                .count(),
+            roi, packet.roi_size, packet.tracked, packet.confidence, airborne,
+            busy, packet.ego_shift);
+        const TrackState state = control.state();
+        if (has_target) {
+            if (state != previous) {
+                pipeline.log->info("event=track_state state={} frame={}",
+                                   trackStateName(state), packet.id);
+                if (state == TrackState::Lost) {
+                    pipeline.log->warn("event=target_lost frame={} "
+                                       "message=\"select it again\"",
+                                       packet.id);
+                }
+            }
+            pipeline.track_state = static_cast<int>(state);
+            if (state != TrackState::Tracking) {
+                pipeline.frames_gated++;
+            }
+        }
+        packet.state = state;
+
+        if (airborne && has_target && state == TrackState::Tracking &&
+            !first_tracked) {
+            first_tracked = true;
+            timeline.mark("first_tracked_frame");
+            pipeline.log->info("event=first_tracked_frame frame={} "
+                               "startup_ms={:.0f}",
+                               packet.id, timeline.at("first_tracked_frame"));
+        }
+        packet.command = out.command;
+        packet.velocity = out.velocity;
+        packet.planar = out.planar;
+        if (out.settling) {
+            pipeline.frames_moving++;
+        }
+        if (out.send) {
+            // Send the command to the drone, set it as busy until it
+            // responds if the command needs a response
+            emit(out.command);
+            busy = fly && out.command.acknowledged();
+        }
+        if (emitted && latencyProbe && packet.stamp >= 0) {
+            latencyProbe->commandEmitted(packet.stamp, packet.captured,
+                                         Clock::now());
+        }
+
+        pipeline.control.record(packet.captured);
+        pushOrDrop(pipeline.render_queue, packet, pipeline.render);
+    }
+}
+
+/**
+ * @brief Render stage helper. Draws the tracking and movement overlays onto a
+ * copy of the frame.
+ *
+ * @param   packet  The packet to draw, `image` is written
+ * @param   pool    The pool to take the buffer for `image` from
+ */
+void drawOverlays(FramePacket &packet, FramePool &pool) {
+    // Copy frame so it isn't edited
+    packet.image_buffer = pool.acquire();
+    packet.image = packet.image_buffer.mat();
+    packet.frame.copyTo(packet.image);
+    drawTracking(packet.image, packet.roi, packet.state, rcControl,
+                 packet.velocity, packet.planar, packet.command);
+}
+
+/**
+ * @brief Everything belonging to one drone or stream: its command link,
+ * stream, tracker, recordings, pipeline and window. Sessions share nothing
+ * but the worker pool and the allocation counters, so one process can follow
+ * a target with each of several drones.
+ */
+struct Session {
+    // Recording name, and the title of the session's window
+    std::string name;
+    std::string window;
+    VehicleKind vehicle = VehicleKind::Tello;
+    std::unique_ptr<CommandLink> link;
+    // The link when the vehicle is simulated, whose camera is the stream
+    SimLink *sim = nullptr;
+    // Local port commands are sent from, and the port the drone streams to
+    int command_port = LOCAL_COMMAND_PORT;
+    int video_port = TELLO_VIDEO_PORT;
+    // Read instead of the drone's stream if set, e.g. a recorded clip
+    std::string stream_url;
+
+    // ROI selection, only used on the main thread by the mouse callback and
+    // the render stage
+    bool select_object = false;
+    // Used to start object tracking or select new ROI
+    int track_object = 0;
+    cv::Mat image;
+    cv::Point2i origin;
+    cv::Rect selection;
+
+    std::unique_ptr<FrameSource> source;
+    cv::Size frame_size;
+    int frame_type = CV_8UC3;
+    // `clean_video` - will save the original frame
+    // `video` - will save the frame with bounding boxes and other items
+    // drawn, for evaluation
+    SegmentedWriter clean_video;
+    SegmentedWriter video;
+    CropRecorder crop_video;
+    H264Relay relay;
+    cv::Ptr<cv::Tracker> tracker;
+    StartupTimeline timeline;
+    std::unique_ptr<FramePool> pool;
+    std::unique_ptr<Pipeline> pipeline;
+
+    // Track stage state, kept between its steps on the worker pool
+    cv::Rect roi; // Region of Interest
+    // starting size of roi
+    cv::Size roi_size;
+    // Datastructure that holds the previous roi sizes
+    std::deque<int> prevs_roi_size;
+    cv::Rect selected;
+    bool new_selection = false;
+    FramePacket track_packet;
+    // Reads the latency probe's frame identifiers
+    FrameStamp stamp_reader;
+    // Estimates the drone's own motion, and the centre of the ROI on the
+    // last tracked frame, to tell it apart from the target's
+    EgoMotion ego;
+    cv::Point2f last_centre;
+    bool has_centre = false;
+    // Re-detects the target in the background, with its last result, the ROI
+    // on the frame it is working on, when it was last given a frame and the
+    // class the target was detected as, negative until it is
+    std::unique_ptr<AsyncDetector> detector;
+    AsyncDetector::Result detection;
+    cv::Rect detect_roi;
+    std::uint64_t last_detect = 0;
+    int target_class = -1;
+    // Initialises the tracker on a new selection without holding up the
+    // track stage
+    TrackerStarter starter;
+    // Keeps frames within `frameDeadline` by lowering quality, if set. The
+    // level the track stage is set up for, the tracker's input scaled for it,
+    // the frames dropped in front of the track stage so far, and the last
+    // tracker result, repeated on frames the tracker skips
+    std::unique_ptr<QualityGovernor> governor;
+    int track_level = 0;
+    cv::Mat track_frame;
+    std::uint64_t track_dropped = 0;
+    bool tracked = false;
+    float confidence = -1;
+    FramePacket record_packet;
+
+    std::thread ingest;
+    std::thread control;
+    // Lands the drone and releases the stream once the session stops
+    std::thread shutdown;
+    MetricsExporter exporter;
+    // Keeps the displayed image's buffer out of the pool until it is replaced
+    FramePool::Lease displayed;
+    // Frames rendered since one was last shown
+    int undisplayed = 0;
+    // Set on the main thread once the session has stopped
+    bool closed = false;
+};
 
 /**
  * @brief User draws box around object to track. This triggers tracker to start
@@ -61,463 +780,1092 @@ bool saveDirty = false;
  * @param   event   The event to decide what action to take
  * @param   x       The x coordinate
  * @param   y       The y coordinate
+ * @param   data    The session whose window it is
  */
-static void onMouse(int event, int x, int y, int, void *) {
-    if (selectObject) {
-        selection.x = MIN(x, origin.x);
-        selection.y = MIN(y, origin.y);
-        selection.width = std::abs(x - origin.x);
-        selection.height = std::abs(y - origin.y);
+static void onMouse(int event, int x, int y, int, void *data) {
+    Session &session = *static_cast<Session *>(data);
+    cv::Rect &selection = session.selection;
+    if (session.select_object) {
+        selection.x = MIN(x, session.origin.x);
+        selection.y = MIN(y, session.origin.y);
+        selection.width = std::abs(x - session.origin.x);
+        selection.height = std::abs(y - session.origin.y);
 
-        selection &= cv::Rect(0, 0, image.cols, image.rows);
+        selection &= cv::Rect(0, 0, session.image.cols, session.image.rows);
     }
 
     switch (event) {
     case cv::EVENT_LBUTTONDOWN:
-        origin = cv::Point(x, y);
+        session.origin = cv::Point(x, y);
         selection = cv::Rect(x, y, 0, 0);
-        selectObject = true;
+        session.select_object = true;
         break;
     case cv::EVENT_LBUTTONUP:
-        selectObject = false;
+        session.select_object = false;
         if (selection.width > 0 && selection.height > 0) {
             // Set up tracker properties in main() loop
-            trackObject = -1;
+            session.track_object = -1;
         }
         break;
     }
 }
 
 /**
- * @brief Generates a command as a string based off the drone position and the
- * centre of the ROI around the object being tracked.
- *
- * @param   origin          The position of the drone
- * @param   target          The centre of the ROI around the object being
- * tracked
- * @param   cm_per_pixel    The number of cms to move per pixel
- * @param   min_step        The minimum number of cms the drone can move
- * @param   max_step        The maximum number of cms the drone can move
- * @return                  A pair containing the `command` as a string and the
- * `velocity` as a point
+ * @brief Track stage helper. The frame the tracker sees at the current
+ * quality level, scaled down into a buffer kept by the session below full
+ * quality.
  */
-std::pair<std::string, Point2i> Steer(const Point2i &origin,
-                                      const Point2i &target,
-                                      const float cm_per_pixel,
-                                      const int min_step, const int max_step) {
-    std::string command;
-    const Point2i velocity{target - origin};
-    // Horizontal difference larger than vertical difference
-    if (abs(velocity.x) > abs(velocity.y)) {
-        // Convert pixel velocity to cm velocity and absolute the value
-        int step = abs(static_cast<int>(velocity.x * cm_per_pixel));
-        if (step <= min_step) {
-            // Return an empty command if movement is less than minimum step
-            return {"", velocity};
-        }
-        step = std::min(step, max_step);
-        // Return right or left depending on sign of velocity
-        if (velocity.x > 0) {
-            command = "right " + std::to_string(step);
-        } else {
-            command = "left " + std::to_string(step);
-        }
-    } else {
-        // Convert pixel velocity to cm velocity and absolute the value
-        int step = abs(static_cast<int>(velocity.y * cm_per_pixel));
-        if (step <= min_step) {
-            // Return an empty command if movement is less than minimum step
-            return {"", velocity};
-        }
-        step = std::min(step, max_step);
-        // Return up or down depending on sign of velocity
-        if (velocity.y < 0) {
-            command = "up " + std::to_string(step);
-        } else {
-            command = "down " + std::to_string(step);
-        }
+const cv::Mat &trackerInput(Session &session, const cv::Mat &frame) {
+    const double scale = QUALITY_LEVELS[session.track_level].track_scale;
+    if (scale == 1) {
+        return frame;
     }
-    return {command, velocity};
+    cv::resize(frame, session.track_frame, cv::Size(), scale, scale,
+               cv::INTER_AREA);
+    return session.track_frame;
 }
 
 /**
- * @brief Generates a command to move the drone longitudinally, based on the
- * size of the ROI compared to the initial size of the ROI
+ * @brief Track stage helper. Initialise the tracker on a frame, at the
+ * current quality level's scale.
  *
- * @param   original_size   The size of the ROI when it was initialised
- * @param   target_size     The size of the target object in the current frame
- * @param   min_step        The minimum number of cms the drone can move
- * @param   roi_scale       The value to define the acceptable scale 1 +/-
- * `roi_scale`
- * @return                  A `string` containing the command to give the drone
+ * @param   session The session
+ * @param   frame   The full size frame
+ * @param   roi     The target, in full size pixels
  */
-std::string LongitudinalMove(const cv::Size &original_size,
-                             const cv::Size &target_size, const int min_step,
-                             const float roi_scale) {
-    std::string command;
-    // The average ratio of height and width of the two Size objects
-    float ratio =
-        ((static_cast<float>(target_size.width) / original_size.width) +
-         ((static_cast<float>(target_size.height)) / original_size.height)) /
-        2;
-
-    /// Move backwards if target is > 1.2 times the initial size
-    // Move forwards if target is < 0.8 times the initial size
-    // Don't move longitudinally
-    if (ratio > 1 + roi_scale) {
-        command = "back " + std::to_string(min_step);
-    } else if (ratio < 1 - roi_scale) {
-        command = "forward " + std::to_string(min_step);
-    } else {
-        command = "";
+void initTracker(Session &session, const cv::Mat &frame, const cv::Rect &roi) {
+    const double scale = QUALITY_LEVELS[session.track_level].track_scale;
+    session.tracker->init(trackerInput(session, frame), scaleRect(roi, scale));
+}
+
+/**
+ * @brief Track stage helper. Update the tracker on a frame, at the current
+ * quality level's scale.
+ *
+ * @param   session The session
+ * @param   frame   The full size frame
+ * @param   roi     The target, in full size pixels, updated
+ * @return          Whether the tracker found the target
+ */
+bool updateTracker(Session &session, const cv::Mat &frame, cv::Rect &roi) {
+    const double scale = QUALITY_LEVELS[session.track_level].track_scale;
+    if (scale == 1) {
+        return session.tracker->update(frame, roi);
     }
-    return command;
+    cv::Rect scaled = scaleRect(roi, scale);
+    const bool tracked =
+        session.tracker->update(trackerInput(session, frame), scaled);
+    roi = scaleRect(scaled, 1 / scale);
+    return tracked;
 }
 
 /**
- * Draws arrows to represent the movement of the drone.
- * Green arrow is the movement the drone is making,
- * the red arrow is movement the drone is not making.
+ * @brief Track stage helper. Set the track stage up for the governor's
+ * level, restarting the tracker on this frame if its scale or backend
+ * changes.
  *
- * @param   image       The current image
- * @param   drone_pos   The position of the drone
- * @param   velocity    The movement needed for drone_pos to match the object's
- * position
+ * @param   session The session, with a governor
+ * @param   frame   The frame to restart the tracker on
  */
-void drawMovement(Mat &image, const Point2i &drone_pos,
-                  const Point2i &velocity) {
-    // Define two points for the horizontal and vertical velocity values
-    const cv::Point2i x_pos(drone_pos.x + velocity.x, drone_pos.y);
-    const cv::Point2i y_pos(drone_pos.x, drone_pos.y + velocity.y);
-    /// Draw the arrows, colour depends on which value is larger
-    // Green for larger (movement drone has selected)
-    // Red for smaller (movement not selected)
-    if (abs(velocity.x) > abs(velocity.y)) {
-        cv::arrowedLine(image, drone_pos, x_pos, {0, 255, 0});
-        cv::arrowedLine(image, drone_pos, y_pos, {0, 0, 255});
-    } else {
-        cv::arrowedLine(image, drone_pos, x_pos, {0, 0, 255});
-        cv::arrowedLine(image, drone_pos, y_pos, {0, 255, 0});
+void applyQuality(Session &session, const cv::Mat &frame) {
+    const QualityLevel &from = QUALITY_LEVELS[session.track_level];
+    const QualityLevel &to = session.governor->settings();
+    session.track_level = session.governor->level();
+    if (from.fast_tracker != to.fast_tracker) {
+        session.tracker = createTracker(to.fast_tracker ? "cf" : trackerName);
+    } else if (from.track_scale == to.track_scale) {
+        return;
+    }
+    if (session.roi.width > 0 && session.roi.height > 0) {
+        initTracker(session, frame, session.roi);
     }
 }
 
 /**
- * @brief Renames the output files to a user specified name.
+ * @brief Track stage helper. Takes the detector's newest result and moves the
+ * tracker onto the target's detection if it has drifted off it or lost it,
+ * then hands the detector this frame if one is due. Neither waits for
+ * inference.
  *
- * @param clean_default The default name for the clean output video file
- * @param dirty_default The default name for the dirty output video file
+ * @param   session The session, with a detector and a target
+ * @param   packet  The tracked frame, updated if the tracker is moved
  */
-void renameOutputs(const std::string clean_default,
-                   const std::string dirty_default) {
-    std::string output_name;
-    std::cout << "\nSpecify output filename for video, if none specified then "
-                 "default will be used, this will overwrite anything saved to "
-                 "the same filename"
-              << std::endl;
-    std::cout << "Output filename: ";
-    getline(std::cin, output_name);
-    if (!output_name.empty()) {
-        std::string clean_name = "../video-output/" + output_name + ".avi";
-        std::string dirty_name =
-            "../video-output/" + output_name + "_dirty.avi";
-        if (rename(clean_default.c_str(), clean_name.c_str()) != 0) {
-            std::cout << "Error moving file" << std::endl;
-        } else {
-            std::cout << "File saved successfully" << std::endl;
+void redetect(Session &session, FramePacket &packet) {
+    Pipeline &pipeline = *session.pipeline;
+    cv::Rect &roi = session.roi;
+    const bool confident =
+        packet.tracked &&
+        (packet.confidence < 0 || packet.confidence >= MIN_CONFIDENCE);
+
+    if (session.detector->poll(session.detection)) {
+        pipeline.detections++;
+        pipeline.detect_latency =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - session.detection.captured)
+                .count();
+        // The detections are of an older frame, so match them against the
+        // ROI on that frame
+        const Detection *best = nullptr;
+        float best_overlap = DETECT_MATCH;
+        for (const Detection &detection : session.detection.detections) {
+            const float match = overlap(detection.box, session.detect_roi);
+            if ((session.target_class < 0 ||
+                 detection.class_id == session.target_class) &&
+                match >= best_overlap) {
+                best = &detection;
+                best_overlap = match;
+            }
         }
-        if (saveDirty) {
-            if (rename(dirty_default.c_str(), dirty_name.c_str()) != 0) {
-                std::cout << "Error moving file" << std::endl;
-            } else {
-                std::cout << "File saved successfully" << std::endl;
+        if (best) {
+            session.target_class = best->class_id;
+            // Carry the detection forward by as far as the tracker has moved
+            // since, unless the tracker cannot be trusted to say
+            cv::Rect anchor = best->box;
+            if (confident) {
+                anchor += (roi.tl() + roi.br()) / 2 -
+                          (session.detect_roi.tl() + session.detect_roi.br()) /
+                              2;
+            }
+            anchor &= cv::Rect(0, 0, packet.frame.cols, packet.frame.rows);
+            if (anchor.area() > 0 &&
+                (!confident || overlap(anchor, roi) < REANCHOR_BELOW)) {
+                initTracker(session, packet.frame, anchor);
+                roi = anchor;
+                packet.tracked = true;
+                packet.confidence = -1;
+                packet.new_target = true;
+                session.prevs_roi_size.clear();
+                session.has_centre = false;
+                pipeline.redetections++;
             }
         }
     }
+
+    if ((!confident || packet.id >= session.last_detect + detectEvery) &&
+        session.detector->submit(packet.frame, packet.id, packet.captured)) {
+        session.last_detect = packet.id;
+        session.detect_roi = roi;
+    }
+}
+
+/**
+ * @brief Track stage helper. Judge a tracked frame against the deadline and
+ * log any change of quality level, which the track stage takes up on the
+ * next frame and the render stage reads from the pipeline.
+ *
+ * @param   session The session, with a governor
+ * @param   packet  The tracked frame
+ */
+void govern(Session &session, const FramePacket &packet) {
+    Pipeline &pipeline = *session.pipeline;
+    QualityGovernor &governor = *session.governor;
+    const std::uint64_t dropped = pipeline.track.dropped;
+    const int previous = governor.level();
+    if (governor.update(std::chrono::duration_cast<std::chrono::microseconds>(
+                            Clock::now() - packet.captured),
+                        dropped - session.track_dropped)) {
+        const auto level = governor.level() > previous
+                               ? spdlog::level::warn
+                               : spdlog::level::info;
+        pipeline.log->log(level,
+                          "event=quality from={} to={} miss_ratio={:.2f} "
+                          "mean_ms={:.1f} frame={}",
+                          QUALITY_LEVELS[previous].name,
+                          governor.settings().name, governor.missRatio(),
+                          governor.meanMs(), packet.id);
+        pipeline.quality_level = governor.level();
+        pipeline.quality_changes++;
+    }
+    session.track_dropped = dropped;
 }
 
 /**
- * @brief Check if the defined ROI is within the allowed size range.
+ * @brief Track stage, one frame per call on the worker pool. Initialises the
+ * tracker on new selections, updates it on every frame, checks the rate of
+ * change of the ROI and re-detects the target if there is a detector.
  *
- * @param   roi_size      The size of the current defined ROI
- * @param   frame_width   The width of the frame
- * @param   frame_height  The height of the frame
- * @param   roi_min       The multiplier to calculate minimum roi size
- * @param   roi_max       The multiplier to calculate maximum roi size
- * @return                `true` - When the defined ROI is of an acceptable size
- * @return                `false` - When the defined ROI is not of an acceptable
- * size
+ * @param   session The session
+ * @return          Whether a frame was tracked
  */
-bool checkROI(cv::Size roi_size, int frame_width, int frame_height,
-              const float roi_min, const float roi_max) {
-    if (roi_size.width > 0.7 * frame_width or
-        roi_size.height > 0.7 * frame_height) {
-        std::cout << "ROI too large, define area again" << std::endl;
+bool trackStep(Session &session) {
+    Pipeline &pipeline = *session.pipeline;
+    if (!pipeline.running) {
         return false;
-    } else if (roi_size.width < 0.05 * frame_width or
-               roi_size.height < 0.05 * frame_height) {
-        std::cout << "ROI too small, define area again" << std::endl;
+    }
+    while (pipeline.selection_queue.tryPop(session.selected)) {
+        session.new_selection = true;
+    }
+    FramePacket &packet = session.track_packet;
+    if (!pipeline.track_queue.tryPop(packet)) {
         return false;
     }
+    cv::Rect &roi = session.roi;
+    if (latencyProbe) {
+        if (const auto stamp = session.stamp_reader.decode(packet.frame)) {
+            packet.stamp = *stamp;
+        }
+    }
+    // The tracker belongs to the starter until it is ready
+    if (session.governor && !session.starter.isPending() &&
+        session.track_level != session.governor->level()) {
+        applyQuality(session, packet.frame);
+    }
+    const QualityLevel &quality = QUALITY_LEVELS[session.track_level];
+
+    // Measure how far the drone's motion moved the image, from the background
+    // around the last ROI, and move the tracker's search window with it
+    if (egoMotion &&
+        session.ego.estimate(packet.frame, roi, packet.ego_shift) &&
+        roi.width > 0 && roi.height > 0) {
+        const float scale = static_cast<float>(quality.track_scale);
+        shiftTracker(session.tracker, packet.ego_shift * scale);
+    }
+
+    // If new object is chosen start the tracker on it in the background,
+    // nothing is tracked until it has caught up with the stream. A selection
+    // made meanwhile waits for the one being started
+    if (session.new_selection && !session.starter.isPending()) {
+        session.new_selection = false;
+        session.roi_size = session.selected.size();
+        roi = cv::Rect();
+
+        // Initialize the tracker if ROI is an acceptable size, otherwise
+        // reset values
+        if (checkROI(session.roi_size, packet.frame.cols, packet.frame.rows,
+                     ROI_MIN, ROI_MAX)) {
+            session.starter.start(session.tracker, packet, session.selected,
+                                  quality.track_scale);
+            // Clear the roi size queue
+            session.prevs_roi_size.clear();
+            session.has_centre = false;
+            session.target_class = -1;
+        }
+    } else if (session.starter.isPending() &&
+               session.starter.follow(packet)) {
+        // Caught up, so this frame is the tracker's next, unless the target
+        // was lost while catching up and the box is only the last failed one
+        if (session.starter.finish(roi)) {
+            packet.new_target = true;
+            pipeline.log->info("event=tracker_ready ready_ms={:.1f} "
+                               "caught_up={} skipped={} frame={}",
+                               session.starter.readyMs(),
+                               session.starter.caughtUp(),
+                               session.starter.skippedFrames(), packet.id);
+        } else {
+            roi = cv::Rect();
+            pipeline.log->warn("event=tracker_ready failed=true "
+                               "ready_ms={:.1f} caught_up={} skipped={} "
+                               "frame={} message=\"select it again\"",
+                               session.starter.readyMs(),
+                               session.starter.caughtUp(),
+                               session.starter.skippedFrames(), packet.id);
+        }
+    }
+
+    // Below full quality the tracker may skip frames, the ROI moves with the
+    // image and the last result stands
+    const bool coast = roi.width > 0 && roi.height > 0 &&
+                       !packet.new_target &&
+                       packet.id % quality.track_every != 0;
+    if (coast) {
+        roi += cv::Point(cvRound(packet.ego_shift.x),
+                         cvRound(packet.ego_shift.y));
+        packet.tracked = session.tracked;
+        packet.confidence = session.confidence;
+        pipeline.frames_coasted++;
+    } else if (roi.width > 0 && roi.height > 0) {
+        // update the tracking result
+        packet.tracked = updateTracker(session, packet.frame, roi);
+        packet.confidence = trackerConfidence(session.tracker);
+        session.tracked = packet.tracked;
+        session.confidence = packet.confidence;
+        pipeline.tracker_updates++;
+        if (!packet.tracked) {
+            pipeline.tracker_failures++;
+        }
+        // What is left of the ROI's movement once the image shift is taken
+        // out is the target's own
+        const cv::Point2f centre = cv::Point2f(roi.tl() + roi.br()) * 0.5f;
+        if (packet.tracked && session.has_centre) {
+            packet.target_motion =
+                centre - session.last_centre - packet.ego_shift;
+        }
+        session.last_centre = centre;
+        session.has_centre = packet.tracked;
+
+        // A failed update leaves a stale ROI, there is no new size to check
+        if (packet.tracked && !rocCheck(roi, session.prevs_roi_size)) {
+            pipeline.log->error("event=unsafe_roc frame={} x={} y={} width={} "
+                                "height={}",
+                                packet.id, roi.x, roi.y, roi.width,
+                                roi.height);
+            pipeline.running = false;
+        }
+    }
+
+    if (session.detector && roi.width > 0 && roi.height > 0) {
+        redetect(session, packet);
+    }
+
+    packet.roi = roi;
+    packet.roi_size = session.roi_size;
+    pipeline.track.record(packet.captured);
+    if (session.governor) {
+        govern(session, packet);
+    }
+    pushOrDrop(pipeline.control_queue, packet, pipeline.control);
+    return true;
+}
+
+/**
+ * @brief Record stage, at most one clean and one overlay frame per call on
+ * the worker pool. Keeps going after the live stages stop until both queues
+ * are empty, then finalises the files itself, so shutdown can land the drone
+ * without waiting for the encoder to flush.
+ *
+ * @param   session The session
+ * @return          Whether a frame was written
+ */
+bool recordStep(Session &session) {
+    Pipeline &pipeline = *session.pipeline;
+    if (pipeline.record_finished) {
+        return false;
+    }
+    FramePacket &packet = session.record_packet;
+    bool written = false;
+    // Write the frame (unedited image) into output file
+    if (pipeline.clean_queue.tryPop(packet)) {
+        session.clean_video.write(packet.frame);
+        pipeline.record.record(packet.captured);
+        written = true;
+    }
+    // Write the image (edited image) into output file, and the window
+    // around the target
+    if (pipeline.dirty_queue.tryPop(packet)) {
+        if (saveDirty) {
+            session.video.write(packet.image);
+        }
+        if (saveCrop) {
+            session.crop_video.write(packet);
+        }
+        written = true;
+    }
+    if (written || !pipeline.upstream_done) {
+        return written;
+    }
+
+    packet = FramePacket();
+    session.clean_video.release();
+    session.video.release();
+    session.crop_video.release();
+    if (pipeline.record_clean) {
+        std::cout << "Saved " << session.clean_video.segments()
+                  << " segment(s) of " << outputBase(session.name, false)
+                  << std::endl;
+    }
+    if (saveDirty) {
+        std::cout << "Saved " << session.video.segments() << " segment(s) of "
+                  << outputBase(session.name, true) << std::endl;
+    }
+    if (saveCrop) {
+        std::cout << "Saved " << session.crop_video.segments()
+                  << " segment(s) of " << outputBase(session.name, false)
+                  << "_crop" << std::endl;
+    }
+    pipeline.record_finished = true;
     return true;
 }
 
 /**
- * @brief Measures the rate of change of the roi, to determine if sudden change
- * occurs.
+ * @brief Print the number of allocations made per frame since the last call,
+ * across every session, and the state of their frame pools.
+ *
+ * @param   sessions    The running sessions
+ * @param   mat_allocations Counts every `cv::Mat` allocation
+ */
+void printAllocations(const std::vector<std::unique_ptr<Session>> &sessions,
+                      const CountingMatAllocator &mat_allocations) {
+    static std::uint64_t last_frames = 0;
+    static std::uint64_t last_mats = 0;
+    static std::uint64_t last_heap = 0;
+    std::uint64_t frames = 0;
+    size_t available = 0;
+    size_t size = 0;
+    std::uint64_t exhausted = 0;
+    for (const auto &session : sessions) {
+        frames += session->pipeline->ingest.processed;
+        available += session->pool->available();
+        size += session->pool->size();
+        exhausted += session->pool->exhausted;
+    }
+    const std::uint64_t mats = mat_allocations.count();
+    const std::uint64_t heap = heapAllocations;
+    const double n = std::max<std::uint64_t>(1, frames - last_frames);
+    std::cout << "allocations per frame: cv::Mat " << (mats - last_mats) / n
+              << ", heap " << (heap - last_heap) / n << ", frame pool "
+              << available << "/" << size << " free, exhausted " << exhausted
+              << std::endl;
+    last_frames = frames;
+    last_mats = mats;
+    last_heap = heap;
+}
+
+/**
+ * @brief Send a command and wait for the drone to answer it.
  *
- * @param   roi     `cv::Rect` the current roi
- * @return          `true` - When the rate of change is safe
- * @return          `false` - When the rate of change is unsafe
+ * @param   link    The drone's command link
+ * @param   command The command
  */
-bool rocCheck(cv::Rect roi) {
-    prevs_roi_size.push_front(roi.area());
-    if (prevs_roi_size.size() > 20) {
-        prevs_roi_size.pop_back();
-        float ratios[19];
-        for (int i = 0; i < prevs_roi_size.size() - 1; i++) {
-            ratios[i] = static_cast<float>(prevs_roi_size.at(i)) /
-                        prevs_roi_size.at(i + 1);
-        }
-        float ratio_avg = 0;
-        for (float n : ratios) {
-            ratio_avg = ratio_avg + n;
-        }
-        ratio_avg = ratio_avg / 19;
-        if (!(ratio_avg < 1.1 and ratio_avg > 0.9)) {
-            std::cout << "Rate of Change is UNSAFE" << std::endl;
+void sendAndWait(CommandLink &link, const std::string &command) {
+    link.sendCommand(command);
+    while (!(link.receiveResponse()))
+        ;
+}
+
+/**
+ * @brief Bring up a session: bind the command link, start the drone's stream,
+ * then open the stream and the writers which need its frame size while the
+ * tracker is warmed up in parallel. Takeoff is left to the control stage.
+ *
+ * @param   session The session
+ * @return          `false` if the drone or its stream could not be reached
+ */
+bool startSession(Session &session) {
+    // create the tracker object, CSRT unless another backend was chosen. The
+    // Tello always streams 960x720, so warming up does not wait for the probe
+    auto tracker_ready = std::async(std::launch::async, [&session]() {
+        session.tracker = createTracker(trackerName);
+        warmUpTracker(session.tracker, cv::Size(960, 720));
+        session.timeline.mark("tracker_warm");
+    });
+
+    // Bind to the drone
+    if (!session.link->bind(session.command_port)) {
+        std::cout << "cannot reach the drone of " << session.name << std::endl;
+        tracker_ready.wait();
+        return false;
+    }
+    session.timeline.mark("bind");
+    if (session.vehicle == VehicleKind::Tello) {
+        // Every drone streams to 11111 unless told otherwise, so the sessions
+        // after the first move theirs to their own port (Tello SDK 2.0)
+        if (session.video_port != TELLO_VIDEO_PORT) {
+            sendAndWait(*session.link,
+                        "port " + std::to_string(TELLO_STATUS_PORT) + " " +
+                            std::to_string(session.video_port));
+        }
+        // Get video feed from tello drone
+        sendAndWait(*session.link, "streamon");
+        session.timeline.mark("streamon");
+    }
+
+    if (session.sim && session.stream_url.empty()) {
+        // The simulated drone's own camera
+        session.source = std::make_unique<SimCameraSource>(*session.sim);
+    } else {
+        // The drone's stream, or the first webcam in place of a camera when
+        // there is no drone
+        std::string stream_url = session.stream_url;
+        if (stream_url.empty()) {
+            stream_url =
+                session.vehicle == VehicleKind::Tello
+                    ? "udp://0.0.0.0:" + std::to_string(session.video_port)
+                    : "0";
+        }
+        // With H.264 passthrough the drone's bitstream is recorded as it
+        // arrives and relayed to the decoder, so the clean video is never
+        // re-encoded
+        if (recordCodec == Codec::H264) {
+            if (!session.relay.start(session.video_port,
+                                     session.video_port + RELAY_PORT_OFFSET,
+                                     outputBase(session.name, false),
+                                     segmentPolicy)) {
+                std::cout << "cannot bind video port for H.264 passthrough"
+                          << std::endl;
+                tracker_ready.wait();
+                return false;
+            }
+            stream_url = session.relay.url();
+        }
+        session.source = openFrameSource(stream_url);
+        if (!session.source) {
+            tracker_ready.wait();
             return false;
         }
     }
+    session.timeline.mark("stream_open");
+    std::cout << session.name << " stream: " << session.source->format()
+              << std::endl;
+    // Get the first frame in order to determine width and height of image
+    cv::Mat frame;
+    if (!session.source->read(frame) || frame.empty()) {
+        tracker_ready.wait();
+        return false;
+    }
+    session.timeline.mark("first_frame");
+    session.frame_size = frame.size();
+    session.frame_type = frame.type();
+
+    // Output video
+    const double fps = session.source->fps();
+    /// Define the codec and video writer objects
+    if (recordCodec != Codec::H264) {
+        session.clean_video.open(outputBase(session.name, false), recordCodec,
+                                 fps, frame.size(), segmentPolicy);
+    }
+    if (saveDirty) {
+        session.video.open(outputBase(session.name, true), dirtyCodec(), fps,
+                           frame.size(), segmentPolicy);
+    }
+    if (saveCrop) {
+        session.crop_video.open(outputBase(session.name, false), fps,
+                                frame.size(), segmentPolicy);
+    }
+    session.timeline.mark("writers");
+    tracker_ready.wait();
     return true;
 }
 
 /**
- * @brief Function to safely close windows and release OpenCV objects
+ * @brief Function to safely land the drone and release the stream. The video
+ * writers are left to the record stage to finalise.
  *
- * @param   cap             `cv::VideoCapture` object
- * @param   video_writers   List of `cv::VideoWriter` objects
- * @param   tello           Drone object
+ * @param   source  The video stream
+ * @param   link    The drone's command link
  */
-void exitSafe(cv::VideoCapture cap, std::list<cv::VideoWriter> video_writers,
-              ctello::Tello &tello) {
-    cv::destroyAllWindows();
-    if (doFlight) {
-        tello.SendCommand("land");
-        while (!(tello.ReceiveResponse()))
-            ;
+void exitSafe(FrameSource &source, CommandLink &link) {
+    if (doFlight || link.simulated()) {
+        if (rcControl) {
+            // Stop any velocity still being applied before landing
+            link.sendCommand("rc 0 0 0 0");
+        }
+        sendAndWait(link, "land");
+    }
+    source.release();
+}
+
+/**
+ * @brief Stop a session once its live stages have stopped, on a thread of its
+ * own so the other sessions keep running meanwhile.
+ *
+ * @param   session The session
+ */
+void stopSession(Session &session) {
+    Pipeline &pipeline = *session.pipeline;
+    session.ingest.join();
+    session.control.join();
+    session.exporter.stop();
+    if (session.detector) {
+        session.detector->stop();
+    }
+    // Land straight away, the record stage drains its queues and closes the
+    // files in the background meanwhile
+    pipeline.upstream_done = true;
+    exitSafe(*session.source, *session.link);
+    if (recordCodec == Codec::H264) {
+        session.relay.stop();
+        std::cout << "Saved " << session.relay.segments() << " segment(s) of "
+                  << outputBase(session.name, false) << std::endl;
     }
-    renameOutputs(CLEAN, DIRTY);
-    cap.release();
-    for (auto cap : video_writers) {
-        cap.release();
+    printPipeline(pipeline);
+    std::cout << pipeline.label << "start up" << std::endl;
+    session.timeline.print(std::cout);
+}
+
+/**
+ * @brief The scheduling policy of a stage named on the command line.
+ *
+ * @param   name    `ingest`, `track`, `control`, `record` or `render`
+ * @return          The policy, or `nullptr` if there is no such stage
+ */
+ThreadPolicy *stagePolicy(const std::string &name) {
+    if (name == "ingest") {
+        return &ingestPolicy;
+    } else if (name == "control") {
+        return &controlPolicy;
+    } else if (name == "track" || name == "record") {
+        return &workerPolicy;
+    } else if (name == "render") {
+        return &renderPolicy;
     }
+    return nullptr;
+}
+
+/**
+ * @brief Parse `STAGE=VALUE` for a stage's scheduling option.
+ *
+ * @param   option  The option's argument
+ * @param   stage   Set to the text before `=`
+ * @param   value   Set to the text after `=`
+ * @return          The stage's policy, or `nullptr` if it is malformed
+ */
+ThreadPolicy *parseStageOption(const std::string &option, std::string &stage,
+                               std::string &value) {
+    const size_t equals = option.find('=');
+    if (equals == std::string::npos) {
+        return nullptr;
+    }
+    stage = option.substr(0, equals);
+    value = option.substr(equals + 1);
+    return value.empty() ? nullptr : stagePolicy(stage);
+}
+
+/**
+ * @brief Apply a stage's scheduling policy to the calling thread, logging
+ * what could not be applied.
+ */
+void applyPolicy(const ThreadPolicy &policy, const char *stage,
+                 spdlog::logger &log) {
+    std::string error;
+    if (!policy.isDefault() && !policy.apply(error)) {
+        log.warn("event=thread_policy stage={} error=\"{}\"", stage, error);
+    }
+}
+
+/**
+ * @brief Parse `HOST:PORT`.
+ *
+ * @return  `false` if there is no port
+ */
+bool parseAddress(const std::string &address, std::string &host, int &port) {
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        return false;
+    }
+    host = address.substr(0, colon);
+    port = std::atoi(address.c_str() + colon + 1);
+    return port > 0;
 }
 
 int main(int argc, char *argv[]) {
+    // Sessions in the order given, `--drone` starts a new one and the
+    // session options that follow it apply to it
+    std::vector<std::unique_ptr<Session>> sessions;
+    sessions.push_back(std::make_unique<Session>());
+    bool valid = true;
+    bool named = false;
+    // The worker stage each scheduling option was given for, `track` and
+    // `record` share one policy so only one of them may be given
+    std::map<std::string, std::string> worker_stages;
     // Check command line arguments and set variables based on these
-    if (argc == 2) {
-        std::cout << argv[1] << std::endl;
-        if (strcmp(argv[1], "eval") == 0 or strcmp(argv[1], "evaluate") == 0) {
+    for (int i = 1; i < argc && valid; i++) {
+        std::cout << argv[i] << std::endl;
+        Session &current = *sessions.back();
+        if (strcmp(argv[i], "eval") == 0 or strcmp(argv[i], "evaluate") == 0) {
             saveDirty = true;
+        } else if (strcmp(argv[i], "crop") == 0) {
+            saveCrop = true;
+        } else if (strcmp(argv[i], "rc") == 0) {
+            rcControl = true;
+        } else if (strcmp(argv[i], "cf") == 0) {
+            trackerName = "cf";
+        } else if (strcmp(argv[i], "fly") == 0) {
+            doFlight = true;
+        } else if (strcmp(argv[i], "ego") == 0) {
+            egoMotion = true;
+        } else if (strcmp(argv[i], "check") == 0) {
+            checkFrames = true;
+        } else if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+            current.name = argv[++i];
+            named = true;
+        } else if (strcmp(argv[i], "--codec") == 0 && i + 1 < argc &&
+                   parseCodec(argv[i + 1], recordCodec)) {
+            i++;
+        } else if (strcmp(argv[i], "--segment-seconds") == 0 && i + 1 < argc) {
+            segmentPolicy.max_seconds = std::atof(argv[++i]);
+        } else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc) {
+            metricsPort = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--segment-mb") == 0 && i + 1 < argc) {
+            segmentPolicy.max_bytes =
+                static_cast<std::uintmax_t>(std::atof(argv[++i]) * 1e6);
+        } else if (strcmp(argv[i], "--latency-probe") == 0) {
+            latencyProbe = std::make_unique<LatencyProbe>();
+        } else if (strcmp(argv[i], "--detector") == 0 && i + 1 < argc) {
+            detectorModel = argv[++i];
+        } else if (strcmp(argv[i], "--detect-size") == 0 && i + 1 < argc) {
+            detectorSize = std::max(32, std::atoi(argv[++i]) / 32 * 32);
+        } else if (strcmp(argv[i], "--detect-every") == 0 && i + 1 < argc) {
+            detectEvery = std::max(1, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            logLevel = spdlog::level::from_str(argv[++i]);
+            // Unknown names are read as `off`
+            valid = logLevel != spdlog::level::off ||
+                    strcmp(argv[i], "off") == 0;
+        } else if (strcmp(argv[i], "--deadline-ms") == 0 && i + 1 < argc) {
+            frameDeadline = std::chrono::microseconds(
+                static_cast<std::int64_t>(std::atof(argv[++i]) * 1000));
+        } else if ((strcmp(argv[i], "--pin") == 0 ||
+                    strcmp(argv[i], "--fifo") == 0 ||
+                    strcmp(argv[i], "--nice") == 0) &&
+                   i + 1 < argc) {
+            const std::string option = argv[i];
+            std::string stage;
+            std::string value;
+            ThreadPolicy *policy = parseStageOption(argv[++i], stage, value);
+            if (policy == &workerPolicy) {
+                std::string &given = worker_stages[option];
+                if (!given.empty() && given != stage) {
+                    std::cout << option << " given for both track and "
+                              << "record, which share the worker threads"
+                              << std::endl;
+                    policy = nullptr;
+                }
+                given = stage;
+            }
+            if (!policy) {
+                valid = false;
+            } else if (option == "--pin") {
+                valid = parseCpus(value, policy->cpus);
+            } else if (option == "--fifo") {
+                policy->fifo = std::clamp(std::atoi(value.c_str()), 1, 99);
+            } else {
+                policy->nice = std::clamp(std::atoi(value.c_str()), -20, 19);
+            }
+        } else if (strcmp(argv[i], "--cv-threads") == 0 && i + 1 < argc) {
+            cvThreads = std::max(0, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workerCount = std::max(0, std::atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            current.stream_url = argv[++i];
+        } else if (strcmp(argv[i], "--drone") == 0 && i + 1 < argc) {
+            std::string host;
+            int port = 0;
+            valid = parseAddress(argv[++i], host, port);
+            // The first `--drone` replaces the default drone, unless options
+            // were already given for it
+            if (current.link || named || !current.stream_url.empty()) {
+                sessions.push_back(std::make_unique<Session>());
+                named = false;
+            }
+            sessions.back()->link = std::make_unique<UdpTelloLink>(host, port);
+        } else if (strcmp(argv[i], "--vehicle") == 0 && i + 1 < argc) {
+            VehicleKind kind = VehicleKind::Tello;
+            valid = parseVehicle(argv[++i], kind);
+            // Starts a session as `--drone` does
+            if (current.link || named || !current.stream_url.empty()) {
+                sessions.push_back(std::make_unique<Session>());
+                named = false;
+            }
+            sessions.back()->vehicle = kind;
+            if (kind == VehicleKind::Sim) {
+                auto sim = std::make_unique<SimLink>();
+                sessions.back()->sim = sim.get();
+                sessions.back()->link = std::move(sim);
+            } else if (kind == VehicleKind::Console) {
+                sessions.back()->link = std::make_unique<ConsoleLink>();
+            }
         } else {
-            std::cout << "Incorrect usage, please use: ";
-            std::cout << "./tracking-drone eval OR ./tracking-drone evaluate"
-                      << std::endl;
-            std::cout << "In order to save video with overlays, video overlays "
-                         "will not be saved";
+            valid = false;
         }
-    } else if (argc > 2) {
+    }
+    // H.264 passthrough records the drone's own stream
+    for (const auto &session : sessions) {
+        valid &= (session->stream_url.empty() &&
+                  session->vehicle == VehicleKind::Tello) ||
+                 recordCodec != Codec::H264;
+    }
+    if (!valid) {
         std::cout << "Incorrect usage, please use: ";
-        std::cout << "./tracking-drone OR ./tracking-drone [OPTION]"
+        std::cout << "./tracking-drone OR ./tracking-drone [OPTION]..."
+                  << std::endl;
+        std::cout << "Options: eval OR evaluate - save video with "
+                     "overlays, crop - save a window around the target with "
+                     "the overlays as data, fly - take off and send "
+                     "commands to the drone, rc - continuous velocity "
+                     "control, cf - correlation filter tracker, ego - "
+                     "compensate for the drone's motion, check - skip "
+                     "duplicate and corrupt frames, --codec mjpg|ffv1|raw|h264 "
+                     "- recording codec, --segment-seconds N, --segment-mb N "
+                     "- split recordings into segments, --metrics-port N - "
+                     "serve metrics on 127.0.0.1:N, 0 to disable, --workers "
+                     "N - threads for tracking and recording, "
+                     "--latency-probe - measure glass to command latency "
+                     "with a stamped probe window, --detector MODEL.onnx - "
+                     "re-detect the target with a YOLOv5 ONNX model, "
+                     "--detect-size N - its input size, --detect-every N - "
+                     "frames between detections, --deadline-ms N - lower "
+                     "quality to track each frame within N ms of capture, "
+                     "--pin STAGE=CPUS, --fifo STAGE=PRIORITY, --nice "
+                     "STAGE=N - schedule a stage's threads (ingest, track, "
+                     "control, record or render; track and record share "
+                     "the worker threads, so give one), --cv-threads N - "
+                     "threads for OpenCV's own parallel loops, "
+                     "--log-level "
+                     "trace|debug|info|warn|error - lowest level logged to "
+                     "the console, --drone "
+                     "HOST:PORT - fly a drone at this address, --vehicle "
+                     "tello|sim|console - fly a drone, a simulated drone or "
+                     "nothing, repeat either for more sessions. Following "
+                     "a --drone or --vehicle, or for the default drone: "
+                     "--name NAME - save the videos as NAME and "
+                     "NAME_dirty, --stream URL - read frames from URL, or "
+                     "camera N, instead of the drone (not with h264)"
                   << std::endl;
         return 0;
     }
 
-    // Instantiate tello object and bind to connected drone
-    ctello::Tello tello{};
-    if (!tello.Bind()) {
-        return 0;
+    // Number everything after the first session, each has its own ports,
+    // window and recordings
+    const bool several = sessions.size() > 1;
+    for (size_t i = 0; i < sessions.size(); i++) {
+        Session &session = *sessions[i];
+        if (!session.link) {
+            // The drone on the Tello's own network
+            session.link = std::make_unique<CTelloLink>();
+        }
+        if (session.name.empty()) {
+            session.name =
+                several ? outputName + "_" + std::to_string(i) : outputName;
+        }
+        session.window = several ? "CTello Stream " + session.name
+                                 : std::string("CTello Stream");
+        session.command_port = LOCAL_COMMAND_PORT + i;
+        session.video_port = TELLO_VIDEO_PORT + i;
     }
+    // Create video output directory if it doesnt exist
+    cv::utils::fs::createDirectory(OUTPUT_DIR);
 
-    // Get video feed from tello drone
-    tello.SendCommand("streamon");
-    while (!(tello.ReceiveResponse()))
-        ;
-    VideoCapture cap{TELLO_STREAM_URL, CAP_FFMPEG};
-    if (!cap.isOpened()) {
-        std::cout << "cannot open camera" << std::endl;
+    // Bring every session up in parallel, while this thread creates the
+    // windows
+    std::vector<std::future<bool>> started;
+    for (const auto &session : sessions) {
+        started.push_back(std::async(std::launch::async, startSession,
+                                     std::ref(*session)));
+    }
+    for (const auto &session : sessions) {
+        // Create window and mouse callback for ROI selection
+        namedWindow(session->window, WINDOW_AUTOSIZE);
+        setMouseCallback(session->window, onMouse, session.get());
+        session->timeline.mark("window");
+    }
+    // Carry on with the sessions which started
+    for (size_t i = 0, kept = 0; i < started.size(); i++) {
+        if (started[i].get()) {
+            std::swap(sessions[kept++], sessions[i]);
+            continue;
+        }
+        std::cout << "cannot open camera of " << sessions[i]->name
+                  << std::endl;
+        cv::destroyWindow(sessions[i]->window);
+        sessions[i].reset();
+    }
+    sessions.erase(std::remove(sessions.begin(), sessions.end(), nullptr),
+                   sessions.end());
+    if (sessions.empty()) {
         return 0;
     }
-
-    cv::Rect roi; // Region of Interest
-    cv::Mat frame;
-
-    // Get the first frame in order to determine width and height of image
-    cap >> frame;
-    int width = frame.cols;
-    int height = frame.rows;
-    std::cout << "Image Width: " << width << std::endl;
-    std::cout << "Image Height: " << height << std::endl;
-
-    // Output video
-    double fps = cap.get(cv::CAP_PROP_FPS);
-    // Create video output directory if it doesnt exist
-    cv::utils::fs::createDirectory("video-output");
-    /// Define the codec and video writer objects
-    // `clean_video` - will save the original frame
-    // `video` - will save the frame with bounding boxes and other items drawn,
-    // for evaluation
-    std::list<cv::VideoWriter> videoWriters;
-    VideoWriter video;
-    VideoWriter clean_video(CLEAN, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
-                            fps, cv::Size(width, height));
-    videoWriters.push_front(clean_video);
-    if (saveDirty) {
-        video.open(DIRTY, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
-                          fps, cv::Size(width, height));
-        videoWriters.push_front(video);
+    for (const auto &session : sessions) {
+        std::cout << session->name << " Image Width: "
+                  << session->frame_size.width << std::endl;
+        std::cout << session->name << " Image Height: "
+                  << session->frame_size.height << std::endl;
     }
 
-    // create a CSRT tracker object
-    cv::Ptr<cv::Tracker> tracker = cv::TrackerCSRT::create();
-
     // Show information
     std::cout << "To start the tracking process draw box around ROI, press ESC "
                  "to quit."
               << std::endl;
 
-    // Create window and mouse callback for ROI selection
-    namedWindow("CTello Stream", WINDOW_AUTOSIZE);
-    setMouseCallback("CTello Stream", onMouse, 0);
+    // Count cv::Mat allocations from here on, and preallocate every frame
+    // buffer the pipelines will need
+    CountingMatAllocator mat_allocations(cv::Mat::getDefaultAllocator());
+    cv::Mat::setDefaultAllocator(&mat_allocations);
 
-    if (doFlight) {
-        tello.SendCommand("takeoff");
-        while (!(tello.ReceiveResponse()))
-            ;
+    // Start the pipelines. Ingest and control block on the network so each
+    // has a thread, track and record share the worker pool, and the main
+    // thread is the render stage of every session because the windows and
+    // mouse callbacks belong to it
+    WorkerPool workers;
+    Logging logging(logLevel);
+    const auto log = logging.create("tracking-drone");
+    if (cvThreads >= 0) {
+        cv::setNumThreads(cvThreads);
     }
-
-    bool busy = false;
-    while (true) {
-        // Get frame from the video
-        cap >> frame;
-        // Stop the program if no more images
-        if (frame.empty()) {
-            exitSafe(cap, videoWriters, tello);
-            break;
+    for (size_t i = 0; i < sessions.size(); i++) {
+        Session &session = *sessions[i];
+        session.pool = std::make_unique<FramePool>(
+            FRAME_POOL_SIZE, session.frame_size, session.frame_type);
+        session.pipeline = std::make_unique<Pipeline>(
+            *session.pool, mat_allocations,
+            several ? "[" + session.name + "] " : std::string());
+        Pipeline &pipeline = *session.pipeline;
+        pipeline.log = logging.create(session.name);
+        pipeline.record_clean = recordCodec != Codec::H264;
+        pipeline.stream_format = session.source->format();
+        if (frameDeadline.count() > 0) {
+            session.governor = std::make_unique<QualityGovernor>(frameDeadline);
         }
-
-        // Copy frame so it isn't edited
-        frame.copyTo(image);
-
-        // Listen for drone response, the drone can only move once it has
-        // completed its previous command
-        if (const auto response = tello.ReceiveResponse()) {
-            std::cout << "Tello: " << *response << std::endl;
-            busy = false;
-        }
-
-        // If new object is chosen update roi and initialise tracker
-        if (trackObject < 0) {
-            roi = selection;
-            roi_size = roi.size();
-
-            // Initialize the tracker if ROI is an acceptable size, otherwise
-            // reset values
-            if (checkROI(roi_size, width, height, ROI_MIN, ROI_MAX)) {
-                // initialize the tracker
-                tracker->init(image, roi);
-                // Don't set up again, unless user selects new ROI
-                trackObject = 1;
-                // Clear the roi size queue
-                prevs_roi_size.clear();
-            } else {
-                trackObject = 0;
-                roi = cv::Rect();
+        if (!detectorModel.empty()) {
+            session.detector = std::make_unique<AsyncDetector>();
+            if (!session.detector->start(detectorModel, detectorSize)) {
+                std::cout << "Re-detection disabled, cannot load "
+                          << detectorModel << std::endl;
+                session.detector.reset();
             }
         }
+        session.ingest = std::thread([&session, &pipeline]() {
+            applyPolicy(ingestPolicy, "ingest", *pipeline.log);
+            ingestStage(pipeline, *session.source);
+        });
+        session.control = std::thread([&session, &pipeline]() {
+            applyPolicy(controlPolicy, "control", *pipeline.log);
+            controlStage(pipeline, *session.link, session.timeline);
+        });
+        workers.add([&session]() { return trackStep(session); });
+        workers.add([&session]() { return recordStep(session); });
+        session.timeline.mark("pipeline");
 
-        // Update tracking if roi is selected
-        if (roi.width > 0 && roi.height > 0) {
-            // update the tracking result
-            tracker->update(image, roi);
+        // Serve live metrics to a dashboard, on its own thread
+        const int port = metricsPort + static_cast<int>(i);
+        if (metricsPort > 0 &&
+            !session.exporter.start(port, [&session](MetricsText &text) {
+                writeMetrics(*session.pipeline, text);
+            })) {
+            std::cout << "Metrics disabled, cannot bind port " << port
+                      << std::endl;
+        }
+    }
+    // No more threads than tasks, or than the cores they are pinned to
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    if (workerCount > 0) {
+        cores = workerCount;
+    } else if (!workerPolicy.cpus.empty()) {
+        cores = static_cast<unsigned>(workerPolicy.cpus.size());
+    }
+    workers.start(std::min<size_t>(cores, 2 * sessions.size()), [&log]() {
+        applyPolicy(workerPolicy, "worker", *log);
+    });
+    // Every other thread has started, so none inherits this
+    applyPolicy(renderPolicy, "render", *log);
 
-            if (!rocCheck(roi)) {
-                exitSafe(cap, videoWriters, tello);
-                break;
+    FramePacket packet;
+    auto last_report = Clock::now();
+    // The latency probe's window, for the drone's camera to film
+    cv::Mat probe_image;
+    if (latencyProbe) {
+        namedWindow("Latency Probe", WINDOW_AUTOSIZE);
+    }
+    size_t open_sessions = sessions.size();
+    while (open_sessions > 0) {
+        const bool probe_drawn =
+            latencyProbe && latencyProbe->render(probe_image);
+        if (probe_drawn) {
+            cv::imshow("Latency Probe", probe_image);
+        }
+        for (const auto &entry : sessions) {
+            Session &session = *entry;
+            if (session.closed) {
+                continue;
+            }
+            Pipeline &pipeline = *session.pipeline;
+            if (!pipeline.running) {
+                // Land this drone while the others carry on
+                session.closed = true;
+                open_sessions--;
+                cv::destroyWindow(session.window);
+                session.shutdown = std::thread(stopSession, std::ref(session));
+                continue;
             }
 
-            // Get centre of roi
-            Point2i object_centre = (roi.br() + roi.tl()) / 2;
-
-            // Draw the tracked object
-            rectangle(image, roi, cv::Scalar(255, 0, 0), 2, 1);
-            circle(image, object_centre, 3, cv::Scalar(255, 0, 0));
-
-            // Call Steer and store the returned pair object {command, velocity}
-            const auto steer = Steer(DRONE_POSITION, object_centre,
-                                     CM_PER_PIXEL, MIN_STEP, MAX_STEP);
-            // Get the command to send to the drone, returned by Steer
-            std::string command{steer.first};
-            if (!command.empty()) {
-                if (!busy) {
-                    if (doFlight) {
-                        // Send the command to the drone if it is not busy and
-                        // program is in flight mode, set drone as busy
-                        tello.SendCommand(command);
-                        busy = true;
-                    }
-                    std::cout << "Command: " << command << std::endl;
+            // Hand a newly drawn selection to the track stage
+            if (session.track_object < 0) {
+                cv::Rect selected = session.selection;
+                if (pipeline.selection_queue.tryPush(selected)) {
+                    // Don't set up again, unless user selects new ROI
+                    session.track_object = 1;
+                    session.timeline.mark("target_selected");
                 }
+            }
 
-                // Draw velocity lines (green for selected red for not selected)
-                drawMovement(image, DRONE_POSITION, steer.second);
-            } else {
-                // If no planar movement needed check for longitudinal
-                command =
-                    LongitudinalMove(roi_size, roi.size(), MIN_STEP, ROI_SCALE);
-                if (!command.empty()) {
-                    if (!busy) {
-                        if (doFlight) {
-                            // Send the command to the drone if it is not busy
-                            // and program is in flight mode, set drone as busy
-                            tello.SendCommand(command);
-                            busy = true;
-                        }
-                        std::cout << "Command: " << command << std::endl;
-                    }
-
-                    // Draw forwards backwards movement
-                    if (command.find("forward") != std::string::npos) {
-                        rectangle(image, roi, cv::Scalar(0, 255, 0), 2, 1);
-                    } else if (command.find("back") != std::string::npos) {
-                        rectangle(image, roi, cv::Scalar(0, 0, 255), 2, 1);
+            bool updated = false;
+            const cv::Rect &selection = session.selection;
+            // Below full quality fewer frames are shown, and the overlay
+            // video may not be recorded
+            const QualityLevel &quality =
+                QUALITY_LEVELS[pipeline.quality_level];
+            while (pipeline.render_queue.tryPop(packet)) {
+                const bool record =
+                    (saveDirty || saveCrop) && quality.record_dirty;
+                const bool show =
+                    ++session.undisplayed >= quality.display_every;
+                // The crop recording keeps the overlays as data, only the
+                // window and the overlay video need them drawn
+                if (show || (record && saveDirty)) {
+                    drawOverlays(packet, pipeline.pool);
+                    // Invert colours in the selection area
+                    if (session.select_object && selection.width > 0 &&
+                        selection.height > 0) {
+                        cv::Mat roi(packet.image, selection);
+                        bitwise_not(roi, roi);
                     }
                 }
+                if (show) {
+                    session.image = packet.image;
+                    session.displayed = packet.image_buffer;
+                    session.undisplayed = 0;
+                    updated = true;
+                }
+                pipeline.render.record(packet.captured);
+                // Write the image (edited image) into output file, if option
+                // selected
+                if (record) {
+                    pushOrDrop(pipeline.dirty_queue, packet, pipeline.record);
+                }
             }
-        }
 
-        // Invert colours in the selection area
-        if (selectObject && selection.width > 0 && selection.height > 0) {
-            cv::Mat roi(image, selection);
-            bitwise_not(roi, roi);
+            // Display the most recent image
+            if (updated) {
+                cv::imshow(session.window, session.image);
+            }
+        }
+        // Quit every session on ESC button
+        const int key = waitKey(1);
+        // Windows are repainted in `waitKey`
+        if (probe_drawn) {
+            latencyProbe->shown();
+        }
+        if (key == 27) {
+            for (const auto &session : sessions) {
+                session->pipeline->running = false;
+            }
         }
 
-        // Display image
-        cv::Mat resize_image;
-
-        // Write the frame (unedited image) into output file
-        clean_video.write(frame);
-        // Write the image (edited image) into output file, if option selected
-        if (saveDirty) {
-            video.write(image);
+        if (Clock::now() - last_report > std::chrono::seconds(10)) {
+            for (const auto &session : sessions) {
+                if (!session->closed) {
+                    printPipeline(*session->pipeline);
+                }
+            }
+            printAllocations(sessions, mat_allocations);
+            if (latencyProbe) {
+                latencyProbe->print(std::cout);
+            }
+            last_report = Clock::now();
         }
+    }
+    packet = FramePacket();
 
-        // cv::resize(image, resize_image, cv::Size(width, height));
-        cv::imshow("CTello Stream", image);
-        // Quit on ESC button
-        if (waitKey(1) == 27) {
-            exitSafe(cap, videoWriters, tello);
-            break;
+    for (const auto &session : sessions) {
+        session->shutdown.join();
+    }
+    // The record stages finish on the pool once their queues are drained
+    for (const auto &session : sessions) {
+        while (!session->pipeline->record_finished) {
+            idle();
         }
     }
-}
\ No newline at end of file
+    workers.stop();
+    // Everything logged is on the console before the final report
+    logging.shutdown();
+    std::ofstream log_file(OUTPUT_DIR + "tracking-drone.log");
+    logging.dump(log_file);
+    printAllocations(sessions, mat_allocations);
+    if (latencyProbe) {
+        latencyProbe->print(std::cout);
+        std::ofstream samples(OUTPUT_DIR + "latency-probe.csv");
+        latencyProbe->write(samples);
+        std::cout << "Latency samples written to " << OUTPUT_DIR
+                  << "latency-probe.csv" << std::endl;
+    }
+    cv::destroyAllWindows();
+}
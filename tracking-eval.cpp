@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/utility.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "evaluation.hpp"
+#include "tracking-core.hpp"
+
+/**
+ * @brief A recorded clip and its ground truth annotation file.
+ */
+struct Clip {
+    std::string name;
+    std::string video;
+    std::string annotations;
+};
+
+/**
+ * @brief Find every video in a directory which has a matching annotation file,
+ * e.g. `flight1.avi` and `flight1.txt`.
+ *
+ * @param   directory   The dataset directory
+ * @return              The clips, sorted by name
+ */
+std::vector<Clip> findClips(const std::string &directory) {
+    std::vector<Clip> clips;
+    std::error_code error;
+    std::filesystem::directory_iterator entries(directory, error);
+    if (error) {
+        std::cout << "Could not read " << directory << ": " << error.message()
+                  << std::endl;
+        return clips;
+    }
+    for (const auto &entry : entries) {
+        const std::filesystem::path path = entry.path();
+        const std::string extension = path.extension().string();
+        if (extension != ".avi" && extension != ".mp4" &&
+            extension != ".mkv") {
+            continue;
+        }
+        std::filesystem::path annotations = path;
+        annotations.replace_extension(".txt");
+        if (!std::filesystem::exists(annotations)) {
+            std::cout << "Skipping " << path.filename().string()
+                      << ", no annotations" << std::endl;
+            continue;
+        }
+        clips.push_back({path.stem().string(), path.string(),
+                         annotations.string()});
+    }
+    std::sort(clips.begin(), clips.end(),
+              [](const Clip &a, const Clip &b) { return a.name < b.name; });
+    return clips;
+}
+
+/**
+ * @brief Run the tracker over a clip, one-pass evaluation: the tracker is
+ * initialised on the first annotated frame and never reset.
+ *
+ * @param   clip            The clip to evaluate
+ * @param   tracker_name    The tracker backend to evaluate
+ * @return                  The per-frame results
+ */
+ClipResult runClip(const Clip &clip, const std::string &tracker_name) {
+    ClipResult result;
+    result.name = clip.name;
+    const std::vector<cv::Rect2d> truth = loadGroundTruth(clip.annotations);
+    cv::VideoCapture cap(clip.video);
+    if (!cap.isOpened()) {
+        std::cout << "Cannot open " << clip.video << std::endl;
+        return result;
+    }
+
+    cv::Ptr<cv::Tracker> tracker = createTracker(tracker_name);
+    std::deque<int> history;
+    cv::Rect roi;
+    bool initialised = false;
+    cv::Mat frame;
+    for (size_t i = 0; i < truth.size() && cap.read(frame); i++) {
+        const cv::Rect2d &expected = truth[i];
+        const bool annotated = expected.width > 0 && expected.height > 0;
+        if (!initialised) {
+            if (annotated) {
+                roi = cv::Rect(expected);
+                tracker->init(frame, roi);
+                initialised = true;
+            }
+            continue;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const bool tracked = tracker->update(frame, roi);
+        result.update_time += std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count();
+        result.frames++;
+        if (!tracked) {
+            result.failures++;
+        }
+        if (!rocCheck(roi, history)) {
+            // The live system would stop here, count it and carry on
+            result.roc_trips++;
+            history.clear();
+        }
+        if (annotated) {
+            result.centre_errors.push_back(centreError(roi, expected));
+            result.overlaps.push_back(tracked ? overlap(roi, expected) : 0);
+        }
+    }
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    std::string dataset;
+    std::string tracker_name = "csrt";
+    std::string report_path = "eval-report.txt";
+    std::string baseline_path;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Check command line arguments and set variables based on these
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--tracker" && i + 1 < argc) {
+            tracker_name = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--report" && i + 1 < argc) {
+            report_path = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (dataset.empty() && arg.rfind("--", 0) != 0) {
+            dataset = arg;
+        } else {
+            dataset.clear();
+            break;
+        }
+    }
+    if (dataset.empty() || !createTracker(tracker_name)) {
+        std::cout << "Incorrect usage, please use: ";
+        std::cout << "./tracking-eval DATASET_DIR [--tracker csrt|kcf|cf] "
+                     "[--threads N] [--report FILE] [--baseline FILE]"
+                  << std::endl;
+        return 0;
+    }
+
+    const std::vector<Clip> clips = findClips(dataset);
+    if (clips.empty()) {
+        std::cout << "No annotated clips found in " << dataset << std::endl;
+        return 0;
+    }
+    threads = std::min<unsigned int>(threads, clips.size());
+    // Clips run in parallel, stop OpenCV also splitting each frame across the
+    // same cores
+    if (threads > 1) {
+        cv::setNumThreads(1);
+    }
+
+    // Workers take the next clip from a shared counter until none are left
+    std::vector<ClipResult> results(clips.size());
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex print_mutex;
+    auto worker = [&]() {
+        for (size_t i = next++; i < clips.size(); i = next++) {
+            results[i] = runClip(clips[i], tracker_name);
+            const Scorecard card = score(results[i]);
+            std::lock_guard<std::mutex> lock(print_mutex);
+            std::cout << "[" << ++done << "/" << clips.size() << "] "
+                      << clips[i].name << " " << card.fps << " fps, precision "
+                      << card.precision << ", auc " << card.auc << std::endl;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned int i = 0; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+
+    std::ofstream report(report_path);
+    writeReport(report, tracker_name, results);
+    report.close();
+    std::cout << "Report written to " << report_path << std::endl;
+    writeReport(std::cout, tracker_name, results);
+
+    if (!baseline_path.empty()) {
+        std::cout << "\nComparison with " << baseline_path << std::endl;
+        compareReports(std::cout, readReport(baseline_path),
+                       readReport(report_path));
+    }
+}
@@ -0,0 +1,173 @@
+#ifndef VEHICLE_HPP
+#define VEHICLE_HPP
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <opencv2/core.hpp>
+
+#include "command-link.hpp"
+#include "frame-source.hpp"
+#include "virtual-plant.hpp"
+
+/**
+ * @brief What a session flies.
+ *
+ * `Tello`      A real drone, through ctello or `--drone HOST:PORT`
+ * `Sim`        A `VirtualPlant` run in real time, which also provides the
+ *              camera
+ * `Console`    Nothing, commands are only printed and acknowledged, for
+ *              benchmarks and CI runs on recorded clips or a webcam
+ */
+enum class VehicleKind { Tello, Sim, Console };
+
+inline const char *vehicleName(VehicleKind kind) {
+    switch (kind) {
+    case VehicleKind::Sim:
+        return "sim";
+    case VehicleKind::Console:
+        return "console";
+    default:
+        return "tello";
+    }
+}
+
+/**
+ * @brief Parse a vehicle name, `tello`, `sim` or `console`.
+ *
+ * @return  `false` if the name is not known
+ */
+inline bool parseVehicle(const std::string &name, VehicleKind &kind) {
+    for (VehicleKind option :
+         {VehicleKind::Tello, VehicleKind::Sim, VehicleKind::Console}) {
+        if (name == vehicleName(option)) {
+            kind = option;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief No drone at all. Every command except `rc` is acknowledged at once,
+ * so the control stage runs exactly as it does in flight.
+ */
+class ConsoleLink : public CommandLink {
+  public:
+    bool bind(int) override { return true; }
+
+    bool sendCommand(std::string_view command) override {
+        if (command.substr(0, 3) != "rc ") {
+            unanswered++;
+        }
+        return true;
+    }
+
+    std::optional<std::string> receiveResponse() override {
+        if (unanswered == 0) {
+            return std::nullopt;
+        }
+        unanswered--;
+        return "ok";
+    }
+
+    bool simulated() const override { return true; }
+
+  private:
+    int unanswered = 0;
+};
+
+/**
+ * @brief A simulated Tello, a `VirtualPlant` stepped to the wall clock
+ * whenever it is used, with its camera rendered at 30fps. Commands come from
+ * the control stage and frames are read by the ingest stage, so every call
+ * takes a lock.
+ */
+class SimLink : public CommandLink {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::microseconds FRAME_PERIOD{33333};
+
+    explicit SimLink(const PlantConfig &config = PlantConfig(),
+                     const cv::Mat &world = cv::Mat())
+        : plant(config, world), view(config.view) {}
+
+    bool bind(int) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        start = Clock::now();
+        next_frame = start;
+        return true;
+    }
+
+    bool sendCommand(std::string_view command) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        advance();
+        plant.send(command);
+        return true;
+    }
+
+    std::optional<std::string> receiveResponse() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        advance();
+        return plant.receive();
+    }
+
+    bool simulated() const override { return true; }
+
+    // Size of the camera view
+    cv::Size viewSize() const { return view; }
+
+    /**
+     * @brief Wait for the next frame time and render the camera view.
+     */
+    void renderFrame(cv::Mat &frame) {
+        std::this_thread::sleep_until(next_frame);
+        next_frame += FRAME_PERIOD;
+        std::lock_guard<std::mutex> lock(mutex);
+        advance();
+        plant.render(frame);
+    }
+
+  private:
+    // Bring the simulation up to the wall clock
+    void advance() {
+        const double elapsed =
+            std::chrono::duration<double>(Clock::now() - start).count();
+        if (elapsed > plant.time()) {
+            plant.step(elapsed - plant.time());
+        }
+    }
+
+    std::mutex mutex;
+    VirtualPlant plant;
+    const cv::Size view;
+    Clock::time_point start = Clock::now();
+    Clock::time_point next_frame = start;
+};
+
+/**
+ * @brief The camera of a `SimLink`.
+ */
+class SimCameraSource : public FrameSource {
+  public:
+    explicit SimCameraSource(SimLink &sim) : sim(sim) {
+        source_format.kind = "sim";
+        source_format.size = sim.viewSize();
+        source_format.pixel_format = "BGR";
+    }
+
+    bool read(cv::Mat &frame) override {
+        sim.renderFrame(frame);
+        return true;
+    }
+
+  private:
+    SimLink &sim;
+};
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef VIRTUAL_PLANT_HPP
+#define VIRTUAL_PLANT_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+/**
+ * @brief Settings for the simulated drone and camera.
+ */
+struct PlantConfig {
+    // Size of the camera view, the Tello's 960x720
+    cv::Size view{960, 720};
+    // Focal length in pixels, the Tello's 82.6 degree horizontal field of view
+    double focal = 545;
+    // Distance to the target when it was selected, cm. At this distance one
+    // pixel is `CM_PER_PIXEL` cm, as `Steer` assumes
+    double distance = 545 * 0.3;
+    // Size of the target, cm
+    cv::Size2d target{40, 40};
+    // Time from sending a command to the drone acting on it, and from
+    // finishing a move to its response arriving, seconds
+    double latency = 0.1;
+    // Age of the frames the controller sees, seconds
+    double video_latency = 0.2;
+    // Standard deviation of actuation error, as a fraction of each command
+    double noise = 0.05;
+    // Standard deviation of hover drift, cm/s
+    double drift = 2;
+    // Speed of discrete moves, e.g. `left 20`, cm/s
+    double move_speed = 60;
+    // Speed at `rc` 100, cm/s and degrees/s
+    double rc_speed = 100;
+    double rc_yaw_rate = 100;
+    // Time constant of the response to `rc` velocity changes, seconds
+    double inertia = 0.2;
+    // Resolution of the rendered world, pixels per cm
+    double world_scale = 4;
+};
+
+/**
+ * @brief Position of the simulated drone relative to where it was when the
+ * target was selected. `x` is right, `y` is up, `z` is towards the target,
+ * all in cm, and `yaw` is clockwise in radians.
+ */
+struct PlantPose {
+    double x = 0;
+    double y = 0;
+    double z = 0;
+    double yaw = 0;
+};
+
+/**
+ * @brief A simulated Tello looking at a flat world with the target at its
+ * centre. It accepts the same SDK command strings as the drone, moves with
+ * latency, lag and noise, and renders the camera view by cropping and zooming
+ * the world image, so that controllers and trackers can be run in a closed
+ * loop faster than real time.
+ *
+ * Time only moves forward in `step`, nothing here reads the clock.
+ */
+class VirtualPlant {
+  public:
+    /**
+     * @param   config  The simulation settings
+     * @param   world   Image of the target plane, the target is at its centre
+     * and it is `config.world_scale` pixels per cm. Empty for a generated
+     * one, which is only made if a view is rendered
+     * @param   seed    Seed for the actuation noise
+     */
+    VirtualPlant(const PlantConfig &config, const cv::Mat &world,
+                 std::uint64_t seed = 1)
+        : config(config), world(world), rng(seed) {}
+
+    /**
+     * @brief Generate a textured world with a patterned target at its centre,
+     * something for a tracker to follow.
+     */
+    static cv::Mat generateWorld(const PlantConfig &config) {
+        const double scale = config.world_scale;
+        cv::Mat world(cv::Size(static_cast<int>(1000 * scale),
+                               static_cast<int>(750 * scale)),
+                      CV_8UC3);
+        cv::RNG texture(0);
+        cv::Mat noise(world.rows / 16, world.cols / 16, CV_8UC3);
+        texture.fill(noise, cv::RNG::UNIFORM, 40, 200);
+        cv::resize(noise, world, world.size(), 0, 0, cv::INTER_CUBIC);
+
+        // A checkerboard with a coloured border, easy to see at any scale
+        const cv::Size target(static_cast<int>(config.target.width * scale),
+                              static_cast<int>(config.target.height * scale));
+        const cv::Rect box((world.cols - target.width) / 2,
+                           (world.rows - target.height) / 2, target.width,
+                           target.height);
+        const int square = std::max(1, target.width / 6);
+        for (int y = 0; y < target.height; y += square) {
+            for (int x = 0; x < target.width; x += square) {
+                const bool dark = ((x + y) / square) % 2 == 0;
+                cv::rectangle(world,
+                              cv::Rect(box.x + x, box.y + y, square, square) &
+                                  box,
+                              dark ? cv::Scalar(20, 20, 20)
+                                   : cv::Scalar(240, 240, 240),
+                              cv::FILLED);
+            }
+        }
+        cv::rectangle(world, box, cv::Scalar(0, 0, 255),
+                      std::max(2, square / 3));
+        return world;
+    }
+
+    /**
+     * @brief Move the drone instantly, e.g. to apply a disturbance after the
+     * target has been selected. Commands in progress are cancelled.
+     */
+    void setPose(const PlantPose &pose) {
+        this->pose = pose;
+        velocity = PlantPose();
+        rc_target = PlantPose();
+        move_remaining = 0;
+        pending.clear();
+        history.clear();
+        history.push_back({now, pose});
+    }
+
+    /**
+     * @brief Send an SDK command, it takes effect after the latency.
+     * Supported: `left`, `right`, `up`, `down`, `forward`, `back`, `cw`,
+     * `ccw` and `rc`, anything else is acknowledged and ignored.
+     */
+    void send(std::string_view command) {
+        pending.push_back({now + config.latency, std::string(command)});
+    }
+
+    /**
+     * @brief The response to the oldest acknowledged command that has
+     * finished, as `ctello::Tello::ReceiveResponse` would return it.
+     */
+    std::optional<std::string> receive() {
+        if (!responses.empty() && responses.front() <= now) {
+            responses.pop_front();
+            return "ok";
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief Advance the simulation.
+     *
+     * @param   dt  Time step, seconds
+     */
+    void step(double dt) {
+        now += dt;
+        while (!pending.empty() && pending.front().first <= now) {
+            apply(pending.front().second);
+            pending.pop_front();
+        }
+
+        if (move_remaining > 0) {
+            // A discrete move in progress, constant speed then stop
+            const double distance = std::min(move_remaining,
+                                             config.move_speed * dt);
+            move_remaining -= distance;
+            pose.x += move_axis.x * distance;
+            pose.y += move_axis.y * distance;
+            pose.z += move_axis.z * distance;
+            pose.yaw += move_axis.yaw * distance;
+            if (move_remaining <= 0) {
+                responses.push_back(now + config.latency);
+            }
+        } else {
+            // `rc` velocity, approached with a first order lag
+            const double blend = 1 - std::exp(-dt / config.inertia);
+            velocity.x += (rc_target.x - velocity.x) * blend;
+            velocity.y += (rc_target.y - velocity.y) * blend;
+            velocity.z += (rc_target.z - velocity.z) * blend;
+            velocity.yaw += (rc_target.yaw - velocity.yaw) * blend;
+            pose.x += velocity.x * dt;
+            pose.y += velocity.y * dt;
+            pose.z += velocity.z * dt;
+            pose.yaw += velocity.yaw * dt;
+        }
+        // Hover drift
+        const double drift = config.drift * std::sqrt(dt);
+        pose.x += rng.gaussian(drift);
+        pose.y += rng.gaussian(drift);
+        // Never fly through the target
+        pose.z = std::min(pose.z, config.distance * 0.8);
+
+        history.push_back({now, pose});
+        while (history.size() > 1 &&
+               history[1].first <= now - config.video_latency) {
+            history.pop_front();
+        }
+    }
+
+    /**
+     * @brief Where the target is in the camera view.
+     *
+     * @param   delayed The view the controller sees, `video_latency` old,
+     * rather than where it is now
+     */
+    cv::Rect targetBox(bool delayed = true) const {
+        const PlantPose &at = delayed ? history.front().second : pose;
+        const double distance = config.distance - at.z;
+        const double zoom = config.focal / distance;
+        const cv::Point2d centre = viewCentre(at);
+        const double width = config.target.width * zoom;
+        const double height = config.target.height * zoom;
+        // Target centre is the world origin
+        const double x = config.view.width / 2.0 - centre.x * zoom;
+        const double y = config.view.height / 2.0 + centre.y * zoom;
+        return cv::Rect(cvRound(x - width / 2), cvRound(y - height / 2),
+                        cvRound(width), cvRound(height));
+    }
+
+    /**
+     * @brief Render the camera view the controller sees.
+     *
+     * @param   view    Set to the view, reused if already the right size
+     */
+    void render(cv::Mat &view) {
+        if (world.empty()) {
+            world = generateWorld(config);
+        }
+        const PlantPose &at = history.front().second;
+        const double distance = config.distance - at.z;
+        // View pixels per world pixel
+        const double zoom = config.focal / distance / config.world_scale;
+        const cv::Point2d centre = viewCentre(at) * config.world_scale;
+        // World pixel of the point the camera is looking at
+        const double world_x = world.cols / 2.0 + centre.x;
+        const double world_y = world.rows / 2.0 - centre.y;
+        const cv::Matx23d transform(
+            zoom, 0, config.view.width / 2.0 - zoom * world_x, 0, zoom,
+            config.view.height / 2.0 - zoom * world_y);
+        cv::warpAffine(world, view, transform, config.view, cv::INTER_LINEAR,
+                       cv::BORDER_REFLECT);
+    }
+
+    const PlantPose &currentPose() const { return pose; }
+    double time() const { return now; }
+
+  private:
+    /**
+     * @brief The point on the target plane at the centre of the view, cm
+     * from the target, x right and y up.
+     */
+    cv::Point2d viewCentre(const PlantPose &at) const {
+        const double distance = config.distance - at.z;
+        return cv::Point2d(at.x + distance * std::tan(at.yaw), at.y);
+    }
+
+    /**
+     * @brief Start acting on a command.
+     */
+    void apply(const std::string &command) {
+        std::istringstream words(command);
+        std::string name;
+        words >> name;
+        const double error = 1 + rng.gaussian(config.noise);
+        if (name == "rc") {
+            double a = 0, b = 0, c = 0, d = 0;
+            words >> a >> b >> c >> d;
+            const double speed = config.rc_speed / 100 * error;
+            rc_target.x = a * speed;
+            rc_target.z = b * speed;
+            rc_target.y = c * speed;
+            rc_target.yaw = d * config.rc_yaw_rate / 100 * error * CV_PI / 180;
+            return;
+        }
+
+        double amount = 0;
+        words >> amount;
+        move_axis = PlantPose();
+        if (name == "right") {
+            move_axis.x = 1;
+        } else if (name == "left") {
+            move_axis.x = -1;
+        } else if (name == "up") {
+            move_axis.y = 1;
+        } else if (name == "down") {
+            move_axis.y = -1;
+        } else if (name == "forward") {
+            move_axis.z = 1;
+        } else if (name == "back") {
+            move_axis.z = -1;
+        } else if (name == "cw" || name == "ccw") {
+            // Turn at the same rate as it moves, degrees for cm
+            move_axis.yaw = (name == "cw" ? 1 : -1) * CV_PI / 180;
+        } else {
+            responses.push_back(now + config.latency);
+            return;
+        }
+        // Discrete moves stop any `rc` velocity, as on the drone
+        velocity = PlantPose();
+        rc_target = PlantPose();
+        move_remaining = std::max(0.0, amount * error);
+        if (move_remaining <= 0) {
+            responses.push_back(now + config.latency);
+        }
+    }
+
+    PlantConfig config;
+    cv::Mat world;
+    cv::RNG rng;
+
+    double now = 0;
+    PlantPose pose;
+    // `rc` velocity and the velocity it is lagging towards, per second
+    PlantPose velocity;
+    PlantPose rc_target;
+    // Direction and distance left of the discrete move in progress
+    PlantPose move_axis;
+    double move_remaining = 0;
+    // Commands waiting out the latency, and when responses arrive
+    std::deque<std::pair<double, std::string>> pending;
+    std::deque<double> responses;
+    // Recent poses, the front is the one the video shows
+    std::deque<std::pair<double, PlantPose>> history{{0, PlantPose()}};
+};
+
+#endif
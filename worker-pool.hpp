@@ -0,0 +1,96 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of threads shared by the compute stages of every
+ * session. Each task is polled in turn and does at most one unit of work per
+ * call, e.g. one frame, so a slow session cannot starve the others.
+ *
+ * A task only ever runs on one thread at a time, so a stage keeps the single
+ * consumer guarantee its input queue needs, and tasks without work back off
+ * together rather than each spinning on a thread of its own.
+ */
+class WorkerPool {
+  public:
+    // Returns whether it did any work
+    using Task = std::function<bool()>;
+
+    ~WorkerPool() { stop(); }
+
+    /**
+     * @brief Add a task, only before `start`.
+     */
+    void add(Task task) { entries.emplace_back(std::move(task)); }
+
+    /**
+     * @brief Start polling the tasks.
+     *
+     * @param   count   The number of threads, normally one per core
+     * @param   setup   Run by each thread before it starts polling, e.g. to
+     *                  set its scheduling
+     */
+    void start(size_t count, std::function<void()> setup = nullptr) {
+        running = true;
+        for (size_t i = 0; i < count; i++) {
+            threads.emplace_back(&WorkerPool::run, this, i, setup);
+        }
+    }
+
+    /**
+     * @brief Stop polling and join the threads, tasks in progress finish.
+     */
+    void stop() {
+        running = false;
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+    }
+
+    size_t size() const { return threads.size(); }
+
+  private:
+    struct Entry {
+        explicit Entry(Task task) : task(std::move(task)) {}
+        Task task;
+        std::atomic<bool> claimed{false};
+    };
+
+    void run(size_t index, const std::function<void()> &setup) {
+        if (setup) {
+            setup();
+        }
+        // Threads start at different tasks so they do not all contend for
+        // the same one
+        size_t next = index;
+        while (running) {
+            bool worked = false;
+            for (size_t i = 0; i < entries.size(); i++) {
+                Entry &entry = entries[(next + i) % entries.size()];
+                if (entry.claimed.exchange(true, std::memory_order_acquire)) {
+                    continue;
+                }
+                worked |= entry.task();
+                entry.claimed.store(false, std::memory_order_release);
+            }
+            next++;
+            if (!worked) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+    }
+
+    // A deque so entries never move, their flags are shared between threads
+    std::deque<Entry> entries;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{false};
+};
+
+#endif